@@ -0,0 +1,100 @@
+#include "acpi.hpp"
+
+#include "limine.hpp"
+#include "log/log.hpp"
+#include "memory/heap.hpp"
+#include "memory/virtual.hpp"
+#include "utils.hpp"
+
+namespace cosmos::acpi {
+    struct [[gnu::packed]] Rsdp {
+        char signature[8];
+        uint8_t checksum;
+        char oem_id[6];
+        uint8_t revision;
+        uint32_t rsdt_address;
+
+        // Revision 2 and newer
+        uint32_t length;
+        uint64_t xsdt_address;
+        uint8_t extended_checksum;
+        uint8_t reserved[3];
+    };
+
+    /// Mapped once during init(), tables with an invalid checksum are left out
+    static const Header** tables = nullptr;
+    static uint32_t table_count = 0;
+
+    bool checksum_valid(const void* data, const uint32_t length) {
+        const auto bytes = static_cast<const uint8_t*>(data);
+        uint8_t sum = 0;
+
+        for (auto i = 0u; i < length; i++) {
+            sum += bytes[i];
+        }
+
+        return sum == 0;
+    }
+
+    bool signature_equals(const char* a, const char* b) {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2] && a[3] == b[3];
+    }
+
+    /// ACPI tables can live in reserved memory which is not part of the direct map, so each one gets mapped on its own
+    const Header* map_table(const uint64_t phys) {
+        const auto header = reinterpret_cast<const Header*>(memory::virt::map_mmio(phys, sizeof(Header)));
+        if (header == nullptr) return nullptr;
+
+        const auto table = reinterpret_cast<const Header*>(memory::virt::map_mmio(phys, header->length));
+        if (table == nullptr || !checksum_valid(table, table->length)) return nullptr;
+
+        return table;
+    }
+
+    bool init() {
+        const auto rsdp_phys = limine::get_rsdp();
+
+        if (rsdp_phys == 0) {
+            WARN("[acpi] Bootloader did not provide the RSDP");
+            return false;
+        }
+
+        const auto rsdp = reinterpret_cast<const Rsdp*>(memory::virt::map_mmio(rsdp_phys, sizeof(Rsdp)));
+        if (rsdp == nullptr || !checksum_valid(rsdp, 20)) return false;
+
+        // The XSDT has 64-bit entries, the RSDT 32-bit ones
+        const auto extended = rsdp->revision >= 2 && rsdp->xsdt_address != 0;
+        const auto root = map_table(extended ? rsdp->xsdt_address : rsdp->rsdt_address);
+
+        if (root == nullptr) {
+            WARN("[acpi] Invalid root table");
+            return false;
+        }
+
+        const auto entries = reinterpret_cast<const uint8_t*>(root) + sizeof(Header);
+        const auto entry_size = extended ? 8u : 4u;
+        const auto count = static_cast<uint32_t>((root->length - sizeof(Header)) / entry_size);
+
+        tables = memory::heap::alloc_array<const Header*>(count);
+        if (tables == nullptr) return false;
+
+        for (auto i = 0u; i < count; i++) {
+            uint64_t phys = 0;
+            utils::memcpy(&phys, entries + i * entry_size, entry_size);
+
+            const auto table = map_table(phys);
+            if (table != nullptr) tables[table_count++] = table;
+        }
+
+        INFO("[acpi] Found %d tables", table_count);
+        return true;
+    }
+
+    const Header* find_table(const char* signature) {
+        for (auto i = 0u; i < table_count; i++) {
+            if (signature_equals(tables[i]->signature, signature)) return tables[i];
+        }
+
+        return nullptr;
+    }
+} // namespace cosmos::acpi
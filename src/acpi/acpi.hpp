@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::acpi {
+    struct [[gnu::packed]] Header {
+        char signature[4];
+        uint32_t length;
+        uint8_t revision;
+        uint8_t checksum;
+        char oem_id[6];
+        char oem_table_id[8];
+        uint32_t oem_revision;
+        uint32_t creator_id;
+        uint32_t creator_revision;
+    };
+
+    struct [[gnu::packed]] GenericAddress {
+        uint8_t space_id;
+        uint8_t bit_width;
+        uint8_t bit_offset;
+        uint8_t access_size;
+        uint64_t address;
+    };
+
+    struct [[gnu::packed]] Hpet {
+        Header header;
+        uint32_t event_timer_block_id;
+        GenericAddress address;
+        uint8_t number;
+        uint16_t minimum_tick;
+        uint8_t page_protection;
+    };
+
+    struct [[gnu::packed]] Madt {
+        Header header;
+        uint32_t local_apic_address;
+        uint32_t flags;
+    };
+
+    enum class MadtType : uint8_t {
+        LocalApic = 0,
+        IoApic = 1,
+        SourceOverride = 2,
+        LocalX2Apic = 9,
+    };
+
+    /// Entries of various types follow the MADT until the end of its length
+    struct [[gnu::packed]] MadtEntry {
+        MadtType type;
+        uint8_t length;
+    };
+
+    struct [[gnu::packed]] MadtIoApic {
+        MadtEntry entry;
+        uint8_t id;
+        uint8_t reserved;
+        uint32_t address;
+        uint32_t gsi_base;
+    };
+
+    /// Maps an ISA IRQ to a different global system interrupt and/or polarity and trigger mode
+    struct [[gnu::packed]] MadtSourceOverride {
+        MadtEntry entry;
+        uint8_t bus;
+        uint8_t source;
+        uint32_t gsi;
+        uint16_t flags;
+    };
+
+    /// Locates the root table through the RSDP provided by the bootloader, returns false if there is none
+    bool init();
+
+    /// Maps and returns the first table with the given 4 character signature, nullptr if it does not exist
+    const Header* find_table(const char* signature);
+} // namespace cosmos::acpi
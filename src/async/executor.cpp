@@ -0,0 +1,125 @@
+#include "executor.hpp"
+
+#include "log/log.hpp"
+#include "utils.hpp"
+
+namespace cosmos::async {
+    constexpr uint32_t POLL_BATCH = 32;
+
+    void init_executor(Executor* executor) {
+        executor->poller = scheduler::create_poller();
+        executor->ready = {};
+        executor->task_count = 0;
+    }
+
+    void destroy_executor(Executor* executor) {
+        scheduler::destroy_poller(executor->poller);
+    }
+
+    void spawn(Executor* executor, Task<> task) {
+        const auto handle = task.release();
+        auto& promise = handle.promise();
+
+        promise.executor = executor;
+
+        executor->ready.push_back(&promise);
+        executor->task_count++;
+    }
+
+    void finish(PromiseBase* promise) {
+        promise->executor->task_count--;
+        promise->handle.destroy();
+    }
+
+    void suspend_on(PromiseBase* promise, const scheduler::EventHandle event) {
+        promise->awaited_event = event;
+
+        if (!scheduler::add_to_poller(promise->executor->poller, event, reinterpret_cast<uint64_t>(promise))) {
+            utils::panic(nullptr, "[async] Event is already awaited by another task of the executor");
+        }
+    }
+
+    void run(Executor* executor) {
+        uint64_t data[POLL_BATCH];
+
+        for (;;) {
+            while (const auto promise = executor->ready.pop_front()) {
+                promise->handle.resume();
+            }
+
+            if (executor->task_count == 0) break;
+
+            const auto count = scheduler::poll(executor->poller, data, POLL_BATCH, true, scheduler::NO_TIMEOUT);
+
+            for (auto i = 0u; i < count; i++) {
+                const auto promise = reinterpret_cast<PromiseBase*>(data[i]);
+
+                scheduler::remove_from_poller(executor->poller, promise->awaited_event);
+                promise->awaited_event = 0;
+
+                executor->ready.push_back(promise);
+            }
+        }
+    }
+
+#ifdef COSMOS_SELF_CHECKS
+    // Self check
+
+    struct CheckState {
+        scheduler::EventHandle event;
+        uint32_t step;
+        bool failed;
+    };
+
+    Task<uint32_t> check_child(const uint32_t value) {
+        co_await sleep(1);
+        co_return value * 2;
+    }
+
+    /// Suspends on the event first, so it only continues once the signaller ran
+    Task<> check_waiter(CheckState* state) {
+        co_await wait_event(state->event);
+
+        if (state->step != 1) state->failed = true;
+        state->step = 2;
+
+        const auto value = co_await check_child(21);
+
+        if (value != 42) state->failed = true;
+        state->step = 3;
+    }
+
+    Task<> check_signaller(CheckState* state) {
+        co_await sleep(2);
+
+        if (state->step != 0) state->failed = true;
+        state->step = 1;
+
+        scheduler::signal_event(state->event);
+    }
+
+    bool self_check() {
+        CheckState state = { .event = scheduler::create_event(nullptr, 0), .step = 0, .failed = false };
+
+        Executor executor;
+        init_executor(&executor);
+
+        spawn(&executor, check_waiter(&state));
+        spawn(&executor, check_signaller(&state));
+        run(&executor);
+
+        destroy_executor(&executor);
+        scheduler::destroy_event(state.event);
+
+        const auto passed = !state.failed && state.step == 3;
+
+        if (passed) {
+            INFO("[async] Executor self check passed");
+        } else {
+            ERROR("[async] Executor self check failed at step %u", state.step);
+        }
+
+        return passed;
+    }
+#endif
+} // namespace cosmos::async
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "scheduler/event.hpp"
+#include "stl/intrusive_list.hpp"
+#include "task.hpp"
+#include "time/timer.hpp"
+
+namespace cosmos::async {
+    /// Runs any number of tasks on the stack of the process calling run(), suspended tasks only cost their frame
+    struct Executor {
+        /// Events the suspended tasks wait on, each reports the promise waiting on it
+        scheduler::PollerHandle poller;
+
+        stl::IntrusiveList<PromiseBase> ready;
+        uint32_t task_count;
+    };
+
+    void init_executor(Executor* executor);
+    void destroy_executor(Executor* executor);
+
+    void spawn(Executor* executor, Task<> task);
+
+    /// Resumes tasks until all spawned ones finished, blocks in scheduler::poll() while every task is waiting
+    void run(Executor* executor);
+
+#ifdef COSMOS_SELF_CHECKS
+    /// Runs two tasks on an executor of the calling process which hand an event to each other, sleep and await a nested task.
+    /// Logs and returns whether everything happened in the expected order. Only built with the self_checks option.
+    bool self_check();
+#endif
+
+    /// Registers the event with the executor of the task, an event can only be awaited by one task of an executor at a time
+    void suspend_on(PromiseBase* promise, scheduler::EventHandle event);
+
+    // Awaitables
+
+    struct EventAwaiter {
+        scheduler::EventHandle event;
+
+        bool await_ready() {
+            return scheduler::check_event(event) && scheduler::reset_event(event);
+        }
+
+        template <typename P>
+        void await_suspend(std::coroutine_handle<P> handle) {
+            suspend_on(&handle.promise(), event);
+        }
+
+        void await_resume() {}
+    };
+
+    struct SleepAwaiter {
+        uint64_t ms;
+
+        time::Timer timer;
+        scheduler::EventHandle event;
+
+        bool await_ready() {
+            return ms == 0;
+        }
+
+        template <typename P>
+        void await_suspend(std::coroutine_handle<P> handle) {
+            event = scheduler::create_event(nullptr, 0);
+            time::init_timer(&timer, scheduler::signal_event, event);
+
+            suspend_on(&handle.promise(), event);
+            time::start_timer(&timer, ms, 0);
+        }
+
+        void await_resume() {
+            if (ms != 0) scheduler::destroy_event(event);
+        }
+    };
+
+    /// Suspends the task until the event is signalled, resets the event
+    inline EventAwaiter wait_event(const scheduler::EventHandle event) {
+        return { .event = event };
+    }
+
+    inline SleepAwaiter sleep(const uint64_t ms) {
+        return { .ms = ms, .timer = {}, .event = 0 };
+    }
+} // namespace cosmos::async
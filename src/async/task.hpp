@@ -0,0 +1,138 @@
+#pragma once
+
+#include "memory/heap.hpp"
+#include "scheduler/event.hpp"
+#include "utils.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <type_traits>
+
+namespace cosmos::async {
+    struct Executor;
+
+    /// State shared by the promises of all tasks, the executor queues them through next and prev
+    struct PromiseBase {
+        PromiseBase* next = nullptr;
+        PromiseBase* prev = nullptr;
+
+        std::coroutine_handle<> handle;
+        Executor* executor = nullptr;
+
+        /// Awaiting task resumed once this one finished, nullptr for tasks spawned on the executor
+        std::coroutine_handle<> continuation;
+
+        /// Event the task is suspended on
+        scheduler::EventHandle awaited_event = 0;
+
+        // Frames come from the kernel heap, there is no global operator new
+        static void* operator new(const std::size_t size) {
+            return memory::heap::alloc(size, 16);
+        }
+
+        static void operator delete(void* ptr) {
+            memory::heap::free(ptr);
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() {
+            utils::panic(nullptr, "[async] Unhandled exception in a task");
+        }
+    };
+
+    /// Called when a spawned task finished, destroys its frame
+    void finish(PromiseBase* promise);
+
+    struct FinalAwaiter {
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept {
+            const auto continuation = handle.promise().continuation;
+            if (continuation) return continuation;
+
+            finish(&handle.promise());
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    template <typename T>
+    struct Promise : PromiseBase {
+        T value{};
+
+        void return_value(T result) {
+            value = result;
+        }
+    };
+
+    template <>
+    struct Promise<void> : PromiseBase {
+        void return_void() {}
+    };
+
+    /// Lazily started coroutine, runs once it is awaited by another task or spawned on an executor
+    template <typename T = void>
+    struct [[nodiscard]] Task {
+        struct promise_type : Promise<T> {
+            Task get_return_object() {
+                const auto handle = std::coroutine_handle<promise_type>::from_promise(*this);
+                this->handle = handle;
+
+                return Task(handle);
+            }
+
+            FinalAwaiter final_suspend() noexcept {
+                return {};
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+
+        explicit Task(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        Task(Task&& other) noexcept : handle(other.handle) {
+            other.handle = nullptr;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task() {
+            if (handle) handle.destroy();
+        }
+
+        /// Gives up ownership of the frame, used when spawning the task
+        std::coroutine_handle<promise_type> release() {
+            const auto released = handle;
+            handle = nullptr;
+
+            return released;
+        }
+
+        // Awaiting
+
+        bool await_ready() noexcept {
+            return false;
+        }
+
+        /// Runs the task on the executor of the awaiting one and switches to it directly
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> caller) noexcept {
+            handle.promise().executor = caller.promise().executor;
+            handle.promise().continuation = caller;
+
+            return handle;
+        }
+
+        T await_resume() noexcept {
+            if constexpr (!std::is_void_v<T>) return handle.promise().value;
+        }
+    };
+} // namespace cosmos::async
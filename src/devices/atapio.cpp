@@ -2,6 +2,7 @@
 
 #include "log/log.hpp"
 #include "stl/bit_field.hpp"
+#include "sync/mutex.hpp"
 #include "utils.hpp"
 #include "vfs/devfs.hpp"
 
@@ -82,6 +83,10 @@ namespace cosmos::devices::atapio {
     static uint8_t bus_primary_drive_head = 0;
     static uint8_t bus_secondary_drive_head = 0;
 
+    /// Held for a whole transfer, the drives of a bus share its registers
+    static sync::Mutex bus_primary_mutex;
+    static sync::Mutex bus_secondary_mutex;
+
     void write_io(const bool bus_primary, const uint16_t port, const uint8_t data) {
         utils::byte_out((bus_primary ? PRIMARY_BUS_IO : SECONDARY_BUS_IO) + port, data);
     }
@@ -164,6 +169,8 @@ namespace cosmos::devices::atapio {
 
         if (sectors == 0) return 0;
 
+        const sync::MutexGuard guard(drive->bus_primary ? bus_primary_mutex : bus_secondary_mutex);
+
         // Select drive
         DriveHead reg;
         reg.use_slave_drive(drive->slave);
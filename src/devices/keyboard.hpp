@@ -140,10 +140,16 @@ namespace cosmos::devices::keyboard {
         bool press;
     };
 
-    constexpr uint64_t IOCTL_CREATE_EVENT = 1;
+    /// Returns the event signalled when keys arrive, it is shared by all readers and must not be destroyed
+    constexpr uint64_t IOCTL_GET_EVENT = 1;
     constexpr uint64_t IOCTL_RESET_BUFFER = 2;
 
+    /// Returns how many events were dropped because readers did not keep up
+    constexpr uint64_t IOCTL_GET_DROPPED = 3;
+
     void init(vfs::Node* node);
 
+    /// Queues the event without taking a lock, drivers can call it from any context which is allowed to signal events.
+    /// It is dropped and counted if the buffer is full.
     void add_event(Event event);
 } // namespace cosmos::devices::keyboard
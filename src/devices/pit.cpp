@@ -1,87 +1,78 @@
 #include "pit.hpp"
 
 #include "interrupts/isr.hpp"
+#include "memory/heap.hpp"
+#include "scheduler/scheduler.hpp"
+#include "sync/spinlock.hpp"
+#include "time/clockevent.hpp"
+#include "time/timer.hpp"
 #include "utils.hpp"
 
 namespace cosmos::devices::pit {
-    struct Repeat {
-        uint64_t ms;
-        HandlerFn fn;
-        uint64_t data;
-    };
-
     constexpr uint16_t CHANNEL0 = 0x40;
     constexpr uint16_t CHANNEL1 = 0x41;
     constexpr uint16_t CHANNEL2 = 0x42;
     constexpr uint16_t COMMAND = 0x43;
 
-    static uint64_t ticks = 0;
-
-    constexpr uint32_t REPEAT_CAPACITY = 8;
-    static Repeat repeats[REPEAT_CAPACITY] = {};
-    static uint32_t repeat_count = 0;
+    /// Gate of channel 2 in bit 0, speaker enable in bit 1 and the output of channel 2 in bit 5
+    constexpr uint16_t PORT_B = 0x61;
 
-    void tick([[maybe_unused]] isr::InterruptInfo* info) {
-        ticks++;
+    constexpr uint32_t FREQUENCY = 1193182;
 
-        for (auto i = 0u; i < repeat_count; i++) {
-            const auto& repeat = repeats[i];
+    static isr::IrqHandler irq_handler;
 
-            if (repeat.ms != 0 && ticks % repeat.ms == 0) {
-                repeat.fn(repeat.data);
-            }
-        }
+    isr::IrqResult tick([[maybe_unused]] isr::InterruptInfo* info, [[maybe_unused]] void* context) {
+        time::clockevent::handle();
+        return isr::IrqResult::Handled;
     }
 
     void start() {
-        asm volatile("cli" ::: "memory");
+        const sync::IrqSaveGuard guard;
         utils::byte_out(COMMAND, 0b00'11'011'0);
 
         constexpr uint32_t divisor = 1193180u / 1000u;
         utils::byte_out(CHANNEL0, divisor & 0xFF);
         utils::byte_out(CHANNEL0, (divisor >> 8) & 0xFF);
 
-        isr::set(0, tick);
-        asm volatile("sti" ::: "memory");
+        isr::init_irq_handler(&irq_handler, tick, nullptr);
+        isr::add_irq_handler(0, &irq_handler);
     }
 
-    bool run_every_x_ms(const uint64_t ms, const HandlerFn fn, const uint64_t data) {
-        asm volatile("cli" ::: "memory");
-
-        for (auto i = 0u; i < REPEAT_CAPACITY; i++) {
-            if (repeats[i].ms == 0) {
-                repeats[i] = {
-                    .ms = ms,
-                    .fn = fn,
-                    .data = data,
-                };
-
-                if (i == repeat_count) {
-                    repeat_count = i + 1;
-                }
-
-                asm volatile("sti" ::: "memory");
-                return true;
-            }
-        }
-
-        asm volatile("sti" ::: "memory");
-        return false;
+    void start_countdown(const uint32_t ms) {
+        const auto count = FREQUENCY * ms / 1000;
+
+        // Gate low and speaker off while the channel is programmed
+        const auto port_b = utils::byte_in(PORT_B) & ~0b11;
+        utils::byte_out(PORT_B, port_b);
+
+        // Channel 2, low and high byte, mode 0 (interrupt on terminal count)
+        utils::byte_out(COMMAND, 0b10'11'000'0);
+        utils::byte_out(CHANNEL2, count & 0xFF);
+        utils::byte_out(CHANNEL2, (count >> 8) & 0xFF);
+
+        // Rising edge of the gate starts the countdown
+        utils::byte_out(PORT_B, port_b | 0b01);
     }
 
-    void timer_destroy(const uint64_t data) {
-        asm volatile("cli" ::: "memory");
+    bool is_countdown_done() {
+        return (utils::byte_in(PORT_B) & (1 << 5)) != 0;
+    }
 
-        repeats[data].ms = 0;
+    bool run_every_x_ms(const uint64_t ms, const HandlerFn fn, const uint64_t data) {
+        const auto timer = memory::heap::alloc<time::Timer>();
+        if (timer == nullptr) return false;
 
-        if (data == repeat_count - 1) {
-            for (auto i = static_cast<int32_t>(repeat_count) - 1; i >= 0; i--) {
-                if (repeats[i].ms != 0) break;
-                repeat_count--;
-            }
-        }
+        time::init_timer(timer, fn, data);
+        time::start_timer(timer, ms, ms);
 
-        asm volatile("sti" ::: "memory");
+        return true;
+    }
+
+    void timer_destroy(const uint64_t data) {
+        const auto timer = reinterpret_cast<time::Timer*>(data);
+
+        time::cancel_timer(timer);
+        memory::heap::free(timer);
     }
 
     void timer_tick(const uint64_t event) {
@@ -89,21 +80,13 @@ namespace cosmos::devices::pit {
     }
 
     scheduler::EventHandle create_timer(const uint64_t ms) {
-        auto found = false;
-        auto index = 0u;
-
-        for (auto i = 0u; i < REPEAT_CAPACITY; i++) {
-            if (repeats[i].ms == 0) {
-                found = true;
-                index = i;
-                break;
-            }
-        }
+        const auto timer = memory::heap::alloc<time::Timer>();
+        if (timer == nullptr) return 0;
 
-        if (!found) return 0;
+        const auto event = scheduler::create_event(timer_destroy, reinterpret_cast<uint64_t>(timer));
 
-        const auto event = scheduler::create_event(timer_destroy, index);
-        run_every_x_ms(ms, timer_tick, event);
+        time::init_timer(timer, timer_tick, event);
+        time::start_timer(timer, ms, ms);
 
         return event;
     }
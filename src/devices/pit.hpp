@@ -8,8 +8,13 @@
 namespace cosmos::devices::pit {
     using HandlerFn = void (*)(uint64_t);
 
+    /// Fires every millisecond, only used when the local APIC timer is not available
     void start();
 
+    /// Starts a countdown on channel 2 without raising interrupts, used to calibrate other timers. At most 54 ms.
+    void start_countdown(uint32_t ms);
+    bool is_countdown_done();
+
     bool run_every_x_ms(uint64_t ms, HandlerFn fn, uint64_t data);
 
     scheduler::EventHandle create_timer(uint64_t ms);
@@ -3,8 +3,10 @@
 #include "interrupts/isr.hpp"
 #include "keyboard.hpp"
 #include "log/log.hpp"
+#include "scheduler/work.hpp"
 #include "utils.hpp"
 #include "stl/bit_field.hpp"
+#include "stl/ring.hpp"
 
 namespace cosmos::devices::ps2kbd {
     constexpr uint16_t DATA = 0x60;
@@ -99,9 +101,13 @@ namespace cosmos::devices::ps2kbd {
     static keyboard::Key normal_key_map[128];
     static keyboard::Key extended_key_map[128];
 
-    void on_data([[maybe_unused]] isr::InterruptInfo* info) {
-        const auto data = utils::byte_in(DATA);
+    /// Scancodes read by the interrupt handler and decoded by the worker process
+    static stl::SpscRing<uint8_t, 64> scancodes;
 
+    static scheduler::Work decode_work;
+    static isr::IrqHandler irq_handler;
+
+    void decode(const uint8_t data) {
         const auto press = !(data & SCAN_RELEASE) ? true : false;
         const auto index = data & ~SCAN_RELEASE;
 
@@ -146,6 +152,27 @@ namespace cosmos::devices::ps2kbd {
         state = 0;
     }
 
+    void decode_pending([[maybe_unused]] uint64_t data) {
+        uint8_t batch[16];
+
+        while (const auto count = scancodes.pop(batch, 16)) {
+            for (auto i = 0u; i < count; i++) {
+                decode(batch[i]);
+            }
+        }
+    }
+
+    isr::IrqResult on_data([[maybe_unused]] isr::InterruptInfo* info, [[maybe_unused]] void* context) {
+        // Nothing in the output buffer, the interrupt came from another device on the line
+        if ((utils::byte_in(STATUS) & 0b1) == 0) return isr::IrqResult::None;
+
+        // Dropped if the worker fell that far behind
+        scancodes.push(utils::byte_in(DATA));
+
+        scheduler::queue_work(&decode_work);
+        return isr::IrqResult::Handled;
+    }
+
     void init_normal_key_map();
     void init_extended_key_map();
 
@@ -232,7 +259,9 @@ namespace cosmos::devices::ps2kbd {
         config.first_interrupt_enable(true);
         if (!send_controller_cmd(0x60, config.raw)) ERROR_CMD(0x60);
 
-        cosmos::isr::set(1, on_data);
+        scheduler::init_work(&decode_work, decode_pending, 0);
+        cosmos::isr::init_irq_handler(&irq_handler, on_data, nullptr);
+        cosmos::isr::add_irq_handler(1, &irq_handler);
 
         return true;
 
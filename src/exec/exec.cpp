@@ -0,0 +1,340 @@
+#include "exec.hpp"
+
+#include "interrupts/isr.hpp"
+#include "log/log.hpp"
+#include "memory/heap.hpp"
+#include "memory/offsets.hpp"
+#include "memory/physical.hpp"
+#include "memory/virtual.hpp"
+#include "smp/smp.hpp"
+#include "stl/intrusive_list.hpp"
+#include "sync/mutex.hpp"
+#include "syscall/syscall.hpp"
+#include "utils.hpp"
+#include "vfs/vfs.hpp"
+
+namespace cosmos::exec {
+    // ELF
+
+    constexpr uint8_t ELF_CLASS_64 = 2;
+    constexpr uint8_t ELF_DATA_LSB = 1;
+    constexpr uint16_t ELF_TYPE_EXEC = 2;
+    constexpr uint16_t ELF_MACHINE_X86_64 = 62;
+
+    constexpr uint32_t SEGMENT_LOAD = 1;
+    constexpr uint32_t SEGMENT_WRITABLE = 1 << 1;
+
+    struct [[gnu::packed]] ElfHeader {
+        uint8_t ident[16];
+        uint16_t type;
+        uint16_t machine;
+        uint32_t version;
+        uint64_t entry;
+        uint64_t program_header_offset;
+        uint64_t section_header_offset;
+        uint32_t flags;
+        uint16_t header_size;
+        uint16_t program_header_size;
+        uint16_t program_header_count;
+        uint16_t section_header_size;
+        uint16_t section_header_count;
+        uint16_t section_names_index;
+    };
+
+    struct [[gnu::packed]] ProgramHeader {
+        uint32_t type;
+        uint32_t flags;
+        uint64_t offset;
+        uint64_t virt;
+        uint64_t phys;
+        uint64_t file_size;
+        uint64_t mem_size;
+        uint64_t align;
+    };
+
+    // Program
+
+    constexpr uint32_t MAX_SEGMENTS = 16;
+
+    /// The stack grows down from here and gets mapped like the segments, one zeroed page at a time
+    constexpr uint64_t STACK_TOP = 0x00007FFFFFF00000;
+    constexpr uint64_t STACK_SIZE = 1024ul * 1024ul;
+
+    struct Segment {
+        uint64_t first_page;
+        uint64_t page_count;
+
+        /// File contents start at virt in the process, the rest of the pages is zero
+        uint64_t virt;
+        uint64_t offset;
+        uint64_t file_size;
+
+        bool writable;
+
+        /// Physical pages of read-only segments shared by every process running the program, 0 until first touched
+        uint64_t* shared_pages;
+    };
+
+    struct Program {
+        Program* next;
+        Program* prev;
+
+        /// Stays open for reading, which keeps the file from being written to or removed
+        vfs::File* file;
+        uint64_t entry;
+
+        Segment segments[MAX_SEGMENTS];
+        uint32_t segment_count;
+
+        /// Guarded by programs_mutex
+        uint32_t references;
+
+        /// Serializes reading from the file and loading shared pages
+        sync::Mutex mutex;
+    };
+
+    static stl::IntrusiveList<Program> programs;
+    static sync::Mutex programs_mutex;
+
+    bool read_at(vfs::File* file, const uint64_t offset, void* buffer, const uint64_t length) {
+        file->ops->seek(file, vfs::SeekType::Start, static_cast<int64_t>(offset));
+        return file->ops->read(file, buffer, length) == length;
+    }
+
+    bool add_segment(Program* program, const ProgramHeader& header, uint64_t& end_page) {
+        if (program->segment_count == MAX_SEGMENTS) return false;
+
+        if (header.file_size > header.mem_size || header.virt % 4096 != header.offset % 4096) return false;
+        if (header.virt + header.mem_size < header.virt || header.virt + header.mem_size > STACK_TOP - STACK_SIZE) return false;
+
+        // Pages get the permissions of a single segment, the headers are sorted by address so overlaps show up here
+        const auto first_page = header.virt / 4096;
+        if (first_page == 0 || first_page < end_page) return false;
+
+        end_page = utils::ceil_div(header.virt + header.mem_size, 4096ul);
+
+        auto& segment = program->segments[program->segment_count++];
+
+        segment.first_page = first_page;
+        segment.page_count = end_page - first_page;
+        segment.virt = header.virt;
+        segment.offset = header.offset;
+        segment.file_size = header.file_size;
+        segment.writable = (header.flags & SEGMENT_WRITABLE) != 0;
+        segment.shared_pages = nullptr;
+
+        if (!segment.writable) {
+            segment.shared_pages = memory::heap::alloc_array<uint64_t>(segment.page_count);
+            if (segment.shared_pages == nullptr) return false;
+
+            utils::memset(segment.shared_pages, 0, segment.page_count * sizeof(uint64_t));
+        }
+
+        return true;
+    }
+
+    /// Only reads the headers, the segments are left in the file
+    bool parse(Program* program) {
+        ElfHeader header;
+        if (!read_at(program->file, 0, &header, sizeof(ElfHeader))) return false;
+
+        if (header.ident[0] != 0x7F || header.ident[1] != 'E' || header.ident[2] != 'L' || header.ident[3] != 'F') return false;
+        if (header.ident[4] != ELF_CLASS_64 || header.ident[5] != ELF_DATA_LSB) return false;
+
+        // Position independent executables would need to be relocated
+        if (header.type != ELF_TYPE_EXEC || header.machine != ELF_MACHINE_X86_64) return false;
+        if (header.program_header_size != sizeof(ProgramHeader)) return false;
+
+        program->entry = header.entry;
+        uint64_t end_page = 0;
+
+        for (auto i = 0u; i < header.program_header_count; i++) {
+            ProgramHeader segment;
+
+            const auto offset = header.program_header_offset + i * sizeof(ProgramHeader);
+            if (!read_at(program->file, offset, &segment, sizeof(ProgramHeader))) return false;
+
+            if (segment.type != SEGMENT_LOAD || segment.mem_size == 0) continue;
+            if (!add_segment(program, segment, end_page)) return false;
+        }
+
+        return program->segment_count > 0;
+    }
+
+    void destroy(Program* program) {
+        for (auto i = 0u; i < program->segment_count; i++) {
+            const auto& segment = program->segments[i];
+            if (segment.shared_pages == nullptr) continue;
+
+            for (auto j = 0u; j < segment.page_count; j++) {
+                if (segment.shared_pages[j] != 0) memory::phys::free_pages(segment.shared_pages[j] / 4096ul, 1);
+            }
+
+            memory::heap::free(segment.shared_pages);
+        }
+
+        vfs::close_file(program->file);
+        memory::heap::free(program);
+    }
+
+    /// Processes running the same file share its program, takes over the file
+    Program* get_program(vfs::File* file) {
+        const sync::MutexGuard guard(programs_mutex);
+
+        for (auto program = programs.head; program != nullptr; program = program->next) {
+            if (program->file->node == file->node) {
+                program->references++;
+                vfs::close_file(file);
+
+                return program;
+            }
+        }
+
+        const auto program = memory::heap::alloc<Program>();
+        utils::memset(program, 0, sizeof(Program));
+
+        program->file = file;
+        program->references = 1;
+
+        if (!parse(program)) {
+            destroy(program);
+            return nullptr;
+        }
+
+        programs.push_back(program);
+        return program;
+    }
+
+    void release(Program* program) {
+        {
+            const sync::MutexGuard guard(programs_mutex);
+            if (--program->references > 0) return;
+
+            programs.remove(program);
+        }
+
+        destroy(program);
+    }
+
+    scheduler::ProcessId run(const stl::StringView path) {
+        const auto file = vfs::open_file(path, vfs::Mode::Read);
+        if (file == nullptr) return 0;
+
+        const auto program = get_program(file);
+        if (program == nullptr) return 0;
+
+        const auto space = memory::virt::create();
+
+        if (space == 0) {
+            release(program);
+            return 0;
+        }
+
+        // Leaves room for argc and the terminators of argv, envp and the auxiliary vector, which are all zero
+        return scheduler::create_user_process(space, program, program->entry, STACK_TOP - 48);
+    }
+
+    // Page faults
+
+    constexpr uint8_t PAGE_FAULT = 14;
+
+    constexpr uint64_t FAULT_PRESENT = 1 << 0;
+    constexpr uint64_t RFLAGS_IF = 1 << 9;
+
+    /// Allocates a page holding the part of the file contents of the segment which falls into it, needs the program mutex
+    uint64_t load_page(const Program* program, const Segment& segment, const uint64_t page) {
+        const auto phys = memory::phys::alloc_pages(1);
+        if (phys == 0) return 0;
+
+        const auto data = reinterpret_cast<uint8_t*>(memory::virt::DIRECT_MAP + phys);
+        utils::memset(data, 0, 4096);
+
+        const auto start = utils::max(page * 4096ul, segment.virt);
+        const auto end = utils::min((page + 1) * 4096ul, segment.virt + segment.file_size);
+
+        if (start < end && !read_at(program->file, segment.offset + (start - segment.virt), data + (start - page * 4096ul), end - start)) {
+            memory::phys::free_pages(phys / 4096ul, 1);
+            return 0;
+        }
+
+        return phys;
+    }
+
+    bool map_private(const uint64_t page, const uint64_t phys) {
+        if (phys == 0) return false;
+        if (memory::virt::map_user_pages(memory::virt::get_current(), page, phys / 4096ul, 1, true, false)) return true;
+
+        memory::phys::free_pages(phys / 4096ul, 1);
+        return false;
+    }
+
+    /// Maps the page holding the address into the current space, fails if it is neither part of a segment nor of the stack
+    bool resolve(Program* program, const uint64_t address) {
+        if (program == nullptr) return false;
+
+        const auto page = address / 4096ul;
+
+        if (address < STACK_TOP && address >= STACK_TOP - STACK_SIZE) {
+            const auto phys = memory::phys::alloc_pages(1);
+            if (phys != 0) utils::memset(reinterpret_cast<void*>(memory::virt::DIRECT_MAP + phys), 0, 4096);
+
+            return map_private(page, phys);
+        }
+
+        for (auto i = 0u; i < program->segment_count; i++) {
+            const auto& segment = program->segments[i];
+            if (page < segment.first_page || page >= segment.first_page + segment.page_count) continue;
+
+            const sync::MutexGuard guard(program->mutex);
+
+            if (segment.writable) return map_private(page, load_page(program, segment, page));
+
+            auto& shared = segment.shared_pages[page - segment.first_page];
+            if (shared == 0) shared = load_page(program, segment, page);
+
+            return shared != 0 && memory::virt::map_user_pages(memory::virt::get_current(), page, shared / 4096ul, 1, false, true);
+        }
+
+        return false;
+    }
+
+    void on_page_fault(isr::InterruptInfo* info) {
+        uint64_t address;
+        asm volatile("mov %%cr2, %0" : "=r"(address));
+
+        const auto user = (info->iret_cs & 3) == 3;
+
+        // Besides user mode only system calls touch user memory, they run with interrupts enabled and are allowed to block
+        const auto can_block = user || ((info->iret_rflags & RFLAGS_IF) != 0 && smp::get_cpu()->preempt_count == 0 &&
+                                        scheduler::get_current_process() != 0);
+
+        if ((info->error & FAULT_PRESENT) == 0 && address < memory::virt::USER_END && can_block) {
+            asm volatile("sti" ::: "memory");
+            const auto resolved = resolve(scheduler::get_program(), address);
+            asm volatile("cli" ::: "memory");
+
+            if (resolved) return;
+        }
+
+        if (user) {
+            ERROR("[exec] Page fault at 0x%llx in user mode, killing process", address);
+            scheduler::exit(syscall::FAILURE);
+        }
+
+        // Bad pointers passed to a system call are the fault of the process, not of the kernel
+        if (address < memory::virt::USER_END) {
+            if (syscall::fixup_user_copy(info)) return;
+
+            if (can_block) {
+                ERROR("[exec] Page fault at 0x%llx during a system call, killing process", address);
+                scheduler::exit(syscall::FAILURE);
+            }
+        }
+
+        utils::panic(info, "Page Fault");
+    }
+
+    void init() {
+        isr::set_exception(PAGE_FAULT, on_page_fault);
+    }
+} // namespace cosmos::exec
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "scheduler/scheduler.hpp"
+#include "stl/string_view.hpp"
+
+namespace cosmos::exec {
+    /// Loaded executable, shared by all processes running the same file
+    struct Program;
+
+    /// Registers the page fault handler which maps program pages, needs isr::init()
+    void init();
+
+    /// Starts the ELF64 executable at the path as a user process, which has to be joined. Only the headers are read here, the
+    /// pages of the segments are read from the file when the process first touches them.
+    /// @return 0 if the file could not be opened or is not a supported executable
+    scheduler::ProcessId run(stl::StringView path);
+
+    /// Drops a reference to the program, the last one frees its shared pages and closes the file
+    void release(Program* program);
+} // namespace cosmos::exec
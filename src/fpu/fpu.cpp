@@ -0,0 +1,188 @@
+#include "fpu.hpp"
+
+#include "interrupts/isr.hpp"
+#include "log/log.hpp"
+#include "memory/heap.hpp"
+#include "smp/smp.hpp"
+#include "utils.hpp"
+
+#include <cstdint>
+
+namespace cosmos::fpu {
+    constexpr uint64_t CR0_MP = 1ul << 1;
+    constexpr uint64_t CR0_EM = 1ul << 2;
+    constexpr uint64_t CR0_TS = 1ul << 3;
+
+    constexpr uint64_t CR4_OSFXSR = 1ul << 9;
+    constexpr uint64_t CR4_OSXMMEXCPT = 1ul << 10;
+    constexpr uint64_t CR4_OSXSAVE = 1ul << 18;
+
+    constexpr uint64_t XCR0_X87 = 1ul << 0;
+    constexpr uint64_t XCR0_SSE = 1ul << 1;
+    constexpr uint64_t XCR0_AVX = 1ul << 2;
+
+    constexpr uint32_t CPUID_XSAVE = 1u << 26;
+    constexpr uint32_t CPUID_AVX = 1u << 28;
+    constexpr uint32_t CPUID_XSAVEOPT = 1u << 0;
+
+    constexpr uint32_t FXSAVE_SIZE = 512;
+    constexpr uint32_t ALIGNMENT = 64;
+
+    constexpr uint16_t DEFAULT_FCW = 0x037F;
+    constexpr uint32_t DEFAULT_MXCSR = 0x1F80;
+
+    constexpr uint8_t DEVICE_NOT_AVAILABLE = 7;
+
+    enum class Method : uint8_t {
+        Fxsave,
+        Xsave,
+        /// Skips components which were not modified since they were restored from the same area
+        Xsaveopt,
+    };
+
+    static Method method = Method::Fxsave;
+    static uint64_t features = 0;
+    static uint32_t state_size = FXSAVE_SIZE;
+
+    // Registers
+
+    uint64_t read_cr0() {
+        uint64_t value;
+        asm volatile("mov %%cr0, %0" : "=r"(value));
+        return value;
+    }
+
+    void write_cr0(const uint64_t value) {
+        asm volatile("mov %0, %%cr0" ::"r"(value) : "memory");
+    }
+
+    uint64_t read_cr4() {
+        uint64_t value;
+        asm volatile("mov %%cr4, %0" : "=r"(value));
+        return value;
+    }
+
+    void write_cr4(const uint64_t value) {
+        asm volatile("mov %0, %%cr4" ::"r"(value) : "memory");
+    }
+
+    void write_xcr0(const uint64_t value) {
+        asm volatile("xsetbv" ::"c"(0), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32)));
+    }
+
+    /// utils::cpuid() does not take a sub-leaf, leaf 0xD needs one
+    void cpuid(const uint32_t leaf, const uint32_t subleaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+        asm volatile("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(subleaf));
+    }
+
+    // State
+
+    void save(void* state) {
+        const auto low = static_cast<uint32_t>(features);
+        const auto high = static_cast<uint32_t>(features >> 32);
+
+        switch (method) {
+            case Method::Fxsave:
+                asm volatile("fxsave64 (%0)" ::"r"(state) : "memory");
+                break;
+            case Method::Xsave:
+                asm volatile("xsave64 (%0)" ::"r"(state), "a"(low), "d"(high) : "memory");
+                break;
+            case Method::Xsaveopt:
+                asm volatile("xsaveopt64 (%0)" ::"r"(state), "a"(low), "d"(high) : "memory");
+                break;
+        }
+    }
+
+    void restore(const void* state) {
+        const auto low = static_cast<uint32_t>(features);
+        const auto high = static_cast<uint32_t>(features >> 32);
+
+        if (method == Method::Fxsave) {
+            asm volatile("fxrstor64 (%0)" ::"r"(state) : "memory");
+        } else {
+            asm volatile("xrstor64 (%0)" ::"r"(state), "a"(low), "d"(high) : "memory");
+        }
+    }
+
+    /// First use of the registers since the last switch, loads the state of the running process
+    void on_device_not_available(isr::InterruptInfo* info) {
+        const auto cpu = smp::get_cpu();
+        if (cpu->fpu_state == nullptr) utils::panic(info, "[fpu] Registers used outside of a process");
+
+        asm volatile("clts" ::: "memory");
+        restore(cpu->fpu_state);
+
+        cpu->fpu_loaded = true;
+    }
+
+    void init() {
+        uint32_t eax, ebx, ecx, edx;
+        cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+        if ((ecx & CPUID_XSAVE) != 0) {
+            features = XCR0_X87 | XCR0_SSE;
+            if ((ecx & CPUID_AVX) != 0) features |= XCR0_AVX;
+
+            cpuid(0xD, 1, &eax, &ebx, &ecx, &edx);
+            method = (eax & CPUID_XSAVEOPT) != 0 ? Method::Xsaveopt : Method::Xsave;
+        }
+
+        init_cpu();
+
+        // The size reported for the enabled components is only valid once XCR0 is set
+        if (method != Method::Fxsave) {
+            cpuid(0xD, 0, &eax, &ebx, &ecx, &edx);
+            state_size = ebx;
+        }
+
+        isr::set_exception(DEVICE_NOT_AVAILABLE, on_device_not_available);
+
+        INFO("[fpu] Using %s with %d byte save areas%s", method == Method::Fxsave ? "FXSAVE" : method == Method::Xsave ? "XSAVE" : "XSAVEOPT",
+             state_size, (features & XCR0_AVX) != 0 ? ", AVX enabled" : "");
+    }
+
+    void init_cpu() {
+        auto cr4 = read_cr4() | CR4_OSFXSR | CR4_OSXMMEXCPT;
+        if (method != Method::Fxsave) cr4 |= CR4_OSXSAVE;
+
+        write_cr4(cr4);
+        if (method != Method::Fxsave) write_xcr0(features);
+
+        // Nothing is loaded yet, the first use traps
+        write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_TS);
+
+        const auto cpu = smp::get_cpu();
+        cpu->fpu_state = nullptr;
+        cpu->fpu_loaded = false;
+    }
+
+    void* create_state() {
+        const auto state = memory::heap::alloc(state_size, ALIGNMENT);
+        utils::memset(state, 0, state_size);
+
+        // An empty XSAVE header puts the extended components into their initial state, only the control words need values
+        *static_cast<uint16_t*>(state) = DEFAULT_FCW;
+        *reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(state) + 24) = DEFAULT_MXCSR;
+
+        return state;
+    }
+
+    void destroy_state(void* state) {
+        memory::heap::free(state);
+    }
+
+    void switch_state(void* old_state, void* new_state) {
+        const auto cpu = smp::get_cpu();
+
+        // Saving right away instead of on the next use keeps the area up to date in case the process moves to another cpu
+        if (cpu->fpu_loaded) {
+            save(old_state);
+
+            cpu->fpu_loaded = false;
+            write_cr0(read_cr0() | CR0_TS);
+        }
+
+        cpu->fpu_state = new_state;
+    }
+} // namespace cosmos::fpu
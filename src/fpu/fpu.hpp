@@ -0,0 +1,17 @@
+#pragma once
+
+namespace cosmos::fpu {
+    /// Enables x87, SSE and AVX state on the bootstrap processor and picks the instructions used to save it, needs smp::init()
+    void init();
+
+    /// Applies the same configuration on an application processor
+    void init_cpu();
+
+    /// Save area holding the initial register state, freed with destroy_state()
+    void* create_state();
+    void destroy_state(void* state);
+
+    /// Called on every context switch with interrupts disabled, new_state is nullptr for the idle loop.
+    /// The registers are only saved if the old process used them and only restored once the new process does.
+    void switch_state(void* old_state, void* new_state);
+} // namespace cosmos::fpu
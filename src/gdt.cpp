@@ -1,8 +1,7 @@
 #include "gdt.hpp"
 
 #include "log/log.hpp"
-
-#include <cstdint>
+#include "smp/smp.hpp"
 
 namespace cosmos::gdt {
     constexpr uint8_t FLAGS_LONG = 0b001'0;
@@ -31,9 +30,27 @@ namespace cosmos::gdt {
         void* address;
     };
 
-    static Entry entries[5];
+    /// Only the stack pointers matter in long mode, the I/O permission bitmap is left out
+    struct [[gnu::packed]] Tss {
+        uint32_t reserved0;
+        uint64_t rsp[3];
+        uint64_t reserved1;
+        uint64_t ist[7];
+        uint64_t reserved2;
+        uint16_t reserved3;
+        uint16_t iopb_offset;
+    };
+
+    constexpr uint8_t ACCESS_TSS = 0b10001001;
+
+    /// The segments are followed by one 16 byte TSS descriptor for each cpu
+    constexpr uint32_t SEGMENT_COUNT = 5;
+
+    static Entry entries[SEGMENT_COUNT + smp::MAX_CPUS * 2];
     static Descriptor descriptor;
 
+    static Tss tss[smp::MAX_CPUS];
+
     Entry entry(const uint32_t base, const uint32_t limit, const uint8_t access, const uint8_t flags) {
         return {
             .limit_low = static_cast<uint16_t>(limit & 0xFFFF),
@@ -51,14 +68,32 @@ namespace cosmos::gdt {
         entries[0] = entry(0, 0, 0, 0);                                                // Null
         entries[1] = entry(0, 0, base_access | ACCESS_EXEC, FLAGS_LONG);               // Kernel - Code
         entries[2] = entry(0, 0, base_access, 0);                                      // Kernel - Data
-        entries[3] = entry(0, 0, base_access | ACCESS_EXEC | ACCESS_USER, FLAGS_LONG); // User - Code
-        entries[4] = entry(0, 0, base_access | ACCESS_USER, 0);                        // User - Data
+        entries[3] = entry(0, 0, base_access | ACCESS_USER, 0);                        // User - Data
+        entries[4] = entry(0, 0, base_access | ACCESS_EXEC | ACCESS_USER, FLAGS_LONG); // User - Code
+
+        for (auto i = 0u; i < smp::MAX_CPUS; i++) {
+            const auto base = reinterpret_cast<uint64_t>(&tss[i]);
+
+            tss[i].iopb_offset = sizeof(Tss);
+
+            // The upper half of the base takes up the following entry
+            entries[SEGMENT_COUNT + i * 2] = entry(static_cast<uint32_t>(base), sizeof(Tss) - 1, ACCESS_TSS, 0);
+            entries[SEGMENT_COUNT + i * 2 + 1] = {
+                .limit_low = static_cast<uint16_t>((base >> 32) & 0xFFFF),
+                .base_low = static_cast<uint16_t>((base >> 48) & 0xFFFF),
+            };
+        }
 
         descriptor = {
             .size = sizeof(entries) - 1,
             .address = entries,
         };
 
+        load();
+        INFO("Switched GDT");
+    }
+
+    void load() {
         asm volatile("lgdt %0" : : "m"(descriptor));
 
         asm volatile(R"(
@@ -75,8 +110,15 @@ namespace cosmos::gdt {
             movw %%ax, %%gs
             movw %%ax, %%ss
         )" ::
-                         : "memory");
+                         : "rax", "memory");
+    }
 
-        INFO("Switched GDT");
+    void load_tss(const uint32_t cpu) {
+        const auto selector = static_cast<uint16_t>((SEGMENT_COUNT + cpu * 2) * sizeof(Entry));
+        asm volatile("ltr %0" ::"r"(selector) : "memory");
+    }
+
+    void set_kernel_stack(const uint64_t rsp) {
+        tss[smp::get_id()].rsp[0] = rsp;
     }
 } // namespace cosmos::gdt
@@ -1,5 +1,23 @@
 #pragma once
 
+#include <cstdint>
+
 namespace cosmos::gdt {
+    constexpr uint16_t KERNEL_CODE = 0x08;
+    constexpr uint16_t KERNEL_DATA = 0x10;
+
+    /// SYSRET expects the user data segment right before the user code segment, both include the requested privilege level 3
+    constexpr uint16_t USER_DATA = 0x18 | 3;
+    constexpr uint16_t USER_CODE = 0x20 | 3;
+
     void init();
+
+    /// Loads the already initialized GDT on the calling cpu, this clears the GS base
+    void load();
+
+    /// Loads the task state segment of the cpu, needed before it can take interrupts in user mode
+    void load_tss(uint32_t cpu);
+
+    /// Sets the stack the calling cpu switches to when an interrupt arrives in user mode
+    void set_kernel_stack(uint64_t rsp);
 } // namespace cosmos::gdt
@@ -0,0 +1,177 @@
+#include "ioapic.hpp"
+
+#include "acpi/acpi.hpp"
+#include "log/log.hpp"
+#include "memory/virtual.hpp"
+#include "sync/spinlock.hpp"
+#include "utils.hpp"
+
+namespace cosmos::ioapic {
+    constexpr uint32_t REG_SELECT = 0x00 / 4;
+    constexpr uint32_t REG_WINDOW = 0x10 / 4;
+
+    constexpr uint32_t REG_VERSION = 0x01;
+    constexpr uint32_t REG_REDIRECTION = 0x10;
+
+    constexpr uint32_t REDIRECTION_ACTIVE_LOW = 1u << 13;
+    constexpr uint32_t REDIRECTION_LEVEL = 1u << 15;
+    constexpr uint32_t REDIRECTION_MASKED = 1u << 16;
+
+    constexpr uint16_t OVERRIDE_POLARITY_MASK = 0b11;
+    constexpr uint16_t OVERRIDE_ACTIVE_LOW = 0b11;
+    constexpr uint16_t OVERRIDE_TRIGGER_MASK = 0b1100;
+    constexpr uint16_t OVERRIDE_LEVEL = 0b1100;
+
+    constexpr uint32_t MAX_IOAPICS = 8;
+    constexpr uint32_t ISA_IRQS = 16;
+
+    struct IoApic {
+        volatile uint32_t* registers;
+
+        uint32_t gsi_base;
+        uint32_t gsi_count;
+    };
+
+    struct IsaIrq {
+        uint32_t gsi;
+        bool active_low;
+        bool level_triggered;
+    };
+
+    /// Protects the select and window register pairs
+    static sync::SpinLock lock;
+
+    static IoApic ioapics[MAX_IOAPICS];
+    static uint32_t ioapic_count = 0;
+
+    /// ISA IRQs are identity mapped, active high and edge triggered unless the MADT overrides them
+    static IsaIrq isa_irqs[ISA_IRQS];
+
+    uint32_t read(const IoApic& ioapic, const uint32_t reg) {
+        ioapic.registers[REG_SELECT] = reg;
+        return ioapic.registers[REG_WINDOW];
+    }
+
+    void write(const IoApic& ioapic, const uint32_t reg, const uint32_t value) {
+        ioapic.registers[REG_SELECT] = reg;
+        ioapic.registers[REG_WINDOW] = value;
+    }
+
+    IoApic* find(const uint32_t gsi) {
+        for (auto i = 0u; i < ioapic_count; i++) {
+            auto& ioapic = ioapics[i];
+            if (gsi >= ioapic.gsi_base && gsi < ioapic.gsi_base + ioapic.gsi_count) return &ioapic;
+        }
+
+        return nullptr;
+    }
+
+    void add(const acpi::MadtIoApic* entry) {
+        if (ioapic_count >= MAX_IOAPICS) return;
+
+        const auto registers = reinterpret_cast<volatile uint32_t*>(memory::virt::map_mmio(entry->address, 4096));
+        if (registers == nullptr) return;
+
+        auto& ioapic = ioapics[ioapic_count++];
+
+        ioapic.registers = registers;
+        ioapic.gsi_base = entry->gsi_base;
+        ioapic.gsi_count = ((read(ioapic, REG_VERSION) >> 16) & 0xFF) + 1;
+
+        for (auto i = 0u; i < ioapic.gsi_count; i++) {
+            write(ioapic, REG_REDIRECTION + i * 2, REDIRECTION_MASKED);
+        }
+    }
+
+    void add(const acpi::MadtSourceOverride* entry) {
+        if (entry->bus != 0 || entry->source >= ISA_IRQS) return;
+
+        auto& irq = isa_irqs[entry->source];
+
+        irq.gsi = entry->gsi;
+        irq.active_low = (entry->flags & OVERRIDE_POLARITY_MASK) == OVERRIDE_ACTIVE_LOW;
+        irq.level_triggered = (entry->flags & OVERRIDE_TRIGGER_MASK) == OVERRIDE_LEVEL;
+    }
+
+    bool init() {
+        const auto madt = reinterpret_cast<const acpi::Madt*>(acpi::find_table("APIC"));
+        if (madt == nullptr) return false;
+
+        for (auto i = 0u; i < ISA_IRQS; i++) {
+            isa_irqs[i] = { .gsi = i, .active_low = false, .level_triggered = false };
+        }
+
+        const auto start = reinterpret_cast<const uint8_t*>(madt) + sizeof(acpi::Madt);
+        const auto end = reinterpret_cast<const uint8_t*>(madt) + madt->header.length;
+
+        for (auto ptr = start; ptr + sizeof(acpi::MadtEntry) <= end;) {
+            const auto entry = reinterpret_cast<const acpi::MadtEntry*>(ptr);
+            if (entry->length < sizeof(acpi::MadtEntry)) break;
+
+            switch (entry->type) {
+            case acpi::MadtType::IoApic:
+                add(reinterpret_cast<const acpi::MadtIoApic*>(entry));
+                break;
+            case acpi::MadtType::SourceOverride:
+                add(reinterpret_cast<const acpi::MadtSourceOverride*>(entry));
+                break;
+            default:
+                break;
+            }
+
+            ptr += entry->length;
+        }
+
+        if (ioapic_count == 0) return false;
+
+        INFO("[ioapic] Found %d I/O APICs", ioapic_count);
+        return true;
+    }
+
+    bool route_gsi(const uint32_t gsi, const uint8_t vector, const uint32_t lapic_id, const bool active_low, const bool level_triggered) {
+        const auto ioapic = find(gsi);
+        if (ioapic == nullptr) return false;
+
+        auto low = static_cast<uint32_t>(vector);
+        if (active_low) low |= REDIRECTION_ACTIVE_LOW;
+        if (level_triggered) low |= REDIRECTION_LEVEL;
+
+        const auto reg = REG_REDIRECTION + (gsi - ioapic->gsi_base) * 2;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        // Destination first so the entry never points at the wrong cpu while it is unmasked
+        write(*ioapic, reg, REDIRECTION_MASKED);
+        write(*ioapic, reg + 1, lapic_id << 24);
+        write(*ioapic, reg, low);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return true;
+    }
+
+    bool route_irq(const uint8_t irq, const uint8_t vector, const uint32_t lapic_id) {
+        if (irq >= ISA_IRQS) return false;
+
+        const auto& isa_irq = isa_irqs[irq];
+        return route_gsi(isa_irq.gsi, vector, lapic_id, isa_irq.active_low, isa_irq.level_triggered);
+    }
+
+    void mask_irq(const uint8_t irq) {
+        if (irq >= ISA_IRQS) return;
+
+        const auto gsi = isa_irqs[irq].gsi;
+        const auto ioapic = find(gsi);
+        if (ioapic == nullptr) return;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        write(*ioapic, REG_REDIRECTION + (gsi - ioapic->gsi_base) * 2, REDIRECTION_MASKED);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+} // namespace cosmos::ioapic
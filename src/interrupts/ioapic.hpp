@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::ioapic {
+    /// Finds the I/O APICs in the MADT and masks all of their inputs, returns false if there are none and the PIC has to stay in use
+    bool init();
+
+    /// Routes an ISA IRQ to a vector on the cpu with the given local APIC id, applying the source overrides of the MADT
+    bool route_irq(uint8_t irq, uint8_t vector, uint32_t lapic_id);
+
+    bool route_gsi(uint32_t gsi, uint8_t vector, uint32_t lapic_id, bool active_low, bool level_triggered);
+
+    void mask_irq(uint8_t irq);
+} // namespace cosmos::ioapic
@@ -1,7 +1,13 @@
 #include "isr.hpp"
 
+#include "ioapic.hpp"
+#include "lapic.hpp"
 #include "log/log.hpp"
 #include "pic.hpp"
+#include "scheduler/scheduler.hpp"
+#include "smp/smp.hpp"
+#include "stats.hpp"
+#include "sync/spinlock.hpp"
 #include "utils.hpp"
 
 namespace cosmos::isr {
@@ -57,10 +63,37 @@ namespace cosmos::isr {
     void isr45();
     void isr46();
     void isr47();
+
+    // Local APIC vectors
+    void isr240();
+    void isr241();
+    void isr242();
+    void isr255();
+
+    // Dynamic vectors 48..239, 16 bytes apart
+    extern char isr_dynamic_stubs[];
     }
 
-    /// Handlers for IRQs 0..15
-    static handler_fn handlers[16];
+    constexpr uint32_t DYNAMIC_COUNT = LAST_DYNAMIC - FIRST_DYNAMIC + 1;
+    constexpr uint32_t DYNAMIC_STUB_SIZE = 16;
+
+    /// Handlers for exceptions 0..31, unhandled ones panic
+    static handler_fn exception_handlers[32];
+
+    /// Handler chains of IRQs 0..15, walked without a lock. Walkers are counted so removal can wait for them.
+    static std::atomic<IrqHandler*> chains[16];
+    static std::atomic<uint32_t> walkers[16];
+    static sync::SpinLock chain_lock;
+
+    /// Handlers for local APIC vectors 0xF0..0xFF
+    static handler_fn ipi_handlers[16];
+
+    /// Handlers for dynamic vectors, a slot is taken while it is not nullptr
+    static IrqHandler* dynamic_handlers[DYNAMIC_COUNT];
+    static sync::SpinLock dynamic_lock;
+
+    /// IRQs 0..15 arrive through the I/O APIC and are acknowledged at the local APIC
+    static bool ioapic_enabled = false;
 
     /// Naked common ISR routine. RSP points to saved r15 (top of saved registers).
     extern "C" __attribute__((naked)) void isr_common() {
@@ -68,6 +101,12 @@ namespace cosmos::isr {
         # 1. Clear Direction Flag
         cld
 
+        # Coming from user mode the GS base still belongs to it, the saved CS tells
+        testb $3, 24(%rsp)
+        jz 1f
+        swapgs
+    1:
+
         # Preserve base pointer and set new frame
         push %rbp
         mov %rsp, %rbp
@@ -119,6 +158,12 @@ namespace cosmos::isr {
         # Remove the two 8-byte values pushed by stubs: interrupt + error
         add $16, %rsp
 
+        # Give user mode its GS base back
+        testb $3, 8(%rsp)
+        jz 2f
+        swapgs
+    2:
+
         # Return from interrupt (pops RIP, CS, RFLAGS [, RSP, SS if present])
         iretq
     )");
@@ -193,13 +238,45 @@ namespace cosmos::isr {
     ISR_NO_ERROR_CODE(46)
     ISR_NO_ERROR_CODE(47)
 
+    // Generate local APIC stubs
+    ISR_NO_ERROR_CODE(240)
+    ISR_NO_ERROR_CODE(241)
+    ISR_NO_ERROR_CODE(242)
+    ISR_NO_ERROR_CODE(255)
+
 #undef ISR_NO_ERROR_CODE
 #undef ISR_ERROR_CODE
 
+    // Generate the stubs of all dynamic vectors, pushq takes a 32-bit immediate above 127 so each stub gets its own 16 bytes
+    extern "C" __attribute__((naked)) void isr_dynamic() {
+        asm volatile(R"(
+        .align 16
+        .global isr_dynamic_stubs
+        isr_dynamic_stubs:
+        .set vector, 48
+        .rept 192
+        .align 16
+        cli
+        pushq $0
+        pushq $vector
+        jmp isr_common
+        .set vector, vector + 1
+        .endr
+    )");
+    }
+
     /// Initialize ISR handling: clear handler table, program PIC entries, enable PIC
     void init() {
         // zero handlers
-        utils::memset(handlers, 0, sizeof(handlers));
+        utils::memset(exception_handlers, 0, sizeof(exception_handlers));
+
+        for (auto i = 0u; i < 16; i++) {
+            chains[i] = nullptr;
+            walkers[i] = 0;
+        }
+
+        utils::memset(ipi_handlers, 0, sizeof(ipi_handlers));
+        utils::memset(dynamic_handlers, 0, sizeof(dynamic_handlers));
 
         pic::init();
 
@@ -255,18 +332,204 @@ namespace cosmos::isr {
         pic::set(46, reinterpret_cast<uint64_t>(isr46), 0x8E);
         pic::set(47, reinterpret_cast<uint64_t>(isr47), 0x8E);
 
+        // Local APIC vectors
+        pic::set(IPI_RESCHEDULE, reinterpret_cast<uint64_t>(isr240), 0x8E);
+        pic::set(IPI_TLB_SHOOTDOWN, reinterpret_cast<uint64_t>(isr241), 0x8E);
+        pic::set(TIMER, reinterpret_cast<uint64_t>(isr242), 0x8E);
+        pic::set(SPURIOUS, reinterpret_cast<uint64_t>(isr255), 0x8E);
+
+        // Dynamic vectors
+        for (auto i = 0u; i < DYNAMIC_COUNT; i++) {
+            pic::set(FIRST_DYNAMIC + i, reinterpret_cast<uint64_t>(isr_dynamic_stubs + i * DYNAMIC_STUB_SIZE), 0x8E);
+        }
+
         pic::update();
 
         INFO("Initialized PIC");
     }
 
-    /// Register an IRQ handler (0..15)
-    void set(const uint8_t num, const handler_fn handler) {
-        if (num < 16) {
-            handlers[num] = handler;
+    void load() {
+        pic::load();
+    }
+
+    /// IRQs are delivered to the bootstrap processor
+    void route(const uint8_t irq) {
+        if (chains[irq].load() != nullptr) {
+            ioapic::route_irq(irq, 32 + irq, smp::get_cpu(0)->lapic_id);
+        } else {
+            ioapic::mask_irq(irq);
         }
     }
 
+    bool init_ioapic() {
+        if (!ioapic::init()) {
+            WARN("[isr] No I/O APIC found, using the PIC");
+            return false;
+        }
+
+        const auto enabled = utils::disable_interrupts();
+
+        pic::disable();
+        ioapic_enabled = true;
+
+        for (auto i = 0u; i < 16; i++) {
+            route(i);
+        }
+
+        utils::restore_interrupts(enabled);
+
+        INFO("[isr] Routing IRQs through the I/O APIC");
+        return true;
+    }
+
+    void init_irq_handler(IrqHandler* handler, const irq_fn fn, void* context) {
+        handler->next = nullptr;
+        handler->fn = fn;
+        handler->context = context;
+    }
+
+    bool add_irq_handler(const uint8_t irq, IrqHandler* handler) {
+        if (irq >= 16) return false;
+
+        const auto enabled = utils::disable_interrupts();
+        chain_lock.lock();
+
+        // Appended so handlers run in the order they were registered
+        handler->next.store(nullptr, std::memory_order_relaxed);
+
+        auto link = &chains[irq];
+        while (const auto other = link->load(std::memory_order_relaxed)) {
+            link = &other->next;
+        }
+
+        const auto first = link == &chains[irq];
+        link->store(handler, std::memory_order_release);
+
+        if (first && ioapic_enabled) route(irq);
+
+        chain_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return true;
+    }
+
+    void remove_irq_handler(const uint8_t irq, IrqHandler* handler) {
+        if (irq >= 16) return;
+
+        const auto enabled = utils::disable_interrupts();
+        chain_lock.lock();
+
+        auto link = &chains[irq];
+        while (const auto other = link->load(std::memory_order_relaxed)) {
+            if (other == handler) {
+                link->store(handler->next.load(std::memory_order_relaxed));
+                break;
+            }
+
+            link = &other->next;
+        }
+
+        if (ioapic_enabled && chains[irq].load() == nullptr) route(irq);
+
+        chain_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        // Walkers which started before the unlink might still be inside the handler
+        while (walkers[irq].load() != 0) {
+            utils::pause();
+        }
+    }
+
+    void set_exception(const uint8_t num, const handler_fn handler) {
+        if (num < 32) {
+            exception_handlers[num] = handler;
+        }
+    }
+
+    /// Register a local APIC vector handler (0xF0..0xFF)
+    void set_ipi(const uint8_t vector, const handler_fn handler) {
+        if (vector >= 0xF0) {
+            ipi_handlers[vector - 0xF0] = handler;
+        }
+    }
+
+    uint8_t alloc_vector(IrqHandler* handler) {
+        const auto enabled = utils::disable_interrupts();
+        dynamic_lock.lock();
+
+        uint8_t vector = 0;
+
+        for (auto i = 0u; i < DYNAMIC_COUNT; i++) {
+            if (dynamic_handlers[i] == nullptr) {
+                dynamic_handlers[i] = handler;
+                vector = FIRST_DYNAMIC + i;
+                break;
+            }
+        }
+
+        dynamic_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return vector;
+    }
+
+    void free_vector(const uint8_t vector) {
+        if (vector < FIRST_DYNAMIC || vector > LAST_DYNAMIC) return;
+
+        const auto enabled = utils::disable_interrupts();
+        dynamic_lock.lock();
+
+        dynamic_handlers[vector - FIRST_DYNAMIC] = nullptr;
+
+        dynamic_lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    /// Runs the handler of a local APIC vector and accounts the time spent in it
+    void call(const handler_fn handler, InterruptInfo* info) {
+        if (handler == nullptr) {
+            record(info->interrupt, 0);
+            return;
+        }
+
+        const auto start = utils::read_tsc();
+        handler(info);
+
+        record(info->interrupt, utils::read_tsc() - start);
+    }
+
+    /// Runs every handler of an IRQ, the interrupt is spurious if none of them claims it
+    void call_chain(const uint8_t irq, InterruptInfo* info) {
+        const auto start = utils::read_tsc();
+        auto result = IrqResult::None;
+
+        walkers[irq].fetch_add(1);
+
+        for (auto handler = chains[irq].load(std::memory_order_acquire); handler != nullptr;
+             handler = handler->next.load(std::memory_order_acquire)) {
+            if (handler->fn(info, handler->context) == IrqResult::Handled) result = IrqResult::Handled;
+        }
+
+        walkers[irq].fetch_sub(1);
+
+        record(info->interrupt, utils::read_tsc() - start);
+        if (result == IrqResult::None) record_spurious(info->interrupt);
+    }
+
+    void call_dynamic(const IrqHandler* handler, InterruptInfo* info) {
+        if (handler == nullptr) {
+            record(info->interrupt, 0);
+            record_spurious(info->interrupt);
+            return;
+        }
+
+        const auto start = utils::read_tsc();
+        const auto result = handler->fn(info, handler->context);
+
+        record(info->interrupt, utils::read_tsc() - start);
+        if (result == IrqResult::None) record_spurious(info->interrupt);
+    }
+
     /// Exception descriptions
     constexpr const char* EXCEPTIONS[] = {
         "Division By Zero",
@@ -316,25 +579,61 @@ namespace cosmos::isr {
 
         // Exceptions (0..31) -> panic
         if (info->interrupt < 32) {
+            const auto handler = exception_handlers[info->interrupt];
+
+            if (handler) {
+                handler(info);
+                return;
+            }
+
             auto name = "Unknown";
 
             if (info->interrupt < (sizeof(EXCEPTIONS) / sizeof(EXCEPTIONS[0]))) {
                 name = EXCEPTIONS[info->interrupt];
             }
 
+            // Only the faulting user process is affected, the kernel state is still consistent
+            if ((info->iret_cs & 3) == 3) {
+                ERROR("[isr] %s in user mode at 0x%llx, killing process", name, info->iret_rip);
+                scheduler::exit(static_cast<uint64_t>(-1));
+            }
+
             utils::panic(info, name);
         }
 
         // IRQs (32..47)
         if (info->interrupt < 48) {
             const auto irq = static_cast<uint8_t>(info->interrupt - 32);
-            const auto handler = handlers[irq];
+            call_chain(irq, info);
 
-            if (handler) {
-                handler(info);
+            if (ioapic_enabled) {
+                lapic::end_irq();
+            } else {
+                pic::end_irq(irq);
             }
 
-            pic::end_irq(irq);
+            scheduler::on_interrupt_exit();
+            return;
+        }
+
+        // Dynamic vectors (48..239)
+        if (info->interrupt <= LAST_DYNAMIC) {
+            call_dynamic(dynamic_handlers[info->interrupt - FIRST_DYNAMIC], info);
+
+            lapic::end_irq();
+            scheduler::on_interrupt_exit();
+            return;
+        }
+
+        // Local APIC vectors (0xF0..0xFF), spurious interrupts must not be acknowledged
+        if (info->interrupt == SPURIOUS) {
+            record(SPURIOUS, 0);
+            record_spurious(SPURIOUS);
+        } else if (info->interrupt >= 0xF0) {
+            call(ipi_handlers[info->interrupt - 0xF0], info);
+
+            lapic::end_irq();
+            scheduler::on_interrupt_exit();
         }
     }
 } // namespace cosmos::isr
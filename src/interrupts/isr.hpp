@@ -2,10 +2,60 @@
 
 #include "info.hpp"
 
+#include <atomic>
+
 namespace cosmos::isr {
     typedef void (*handler_fn)(InterruptInfo* info);
 
+    enum class IrqResult : uint8_t {
+        /// The device behind the handler did not raise the interrupt
+        None,
+        Handled,
+    };
+
+    typedef IrqResult (*irq_fn)(InterruptInfo* info, void* context);
+
+    /// Owned by the caller, linked into the chain of its IRQ while it is registered
+    struct IrqHandler {
+        std::atomic<IrqHandler*> next;
+
+        irq_fn fn;
+        void* context;
+    };
+
+    constexpr uint8_t IPI_RESCHEDULE = 0xF0;
+    constexpr uint8_t IPI_TLB_SHOOTDOWN = 0xF1;
+    constexpr uint8_t TIMER = 0xF2;
+    constexpr uint8_t SPURIOUS = 0xFF;
+
+    /// Vectors between the legacy IRQs and the local APIC vectors, handed out by alloc_vector()
+    constexpr uint8_t FIRST_DYNAMIC = 48;
+    constexpr uint8_t LAST_DYNAMIC = 0xEF;
+
     void init();
 
-    void set(uint8_t num, handler_fn handler);
+    /// Moves IRQs 0..15 from the PIC to the I/O APICs described by the MADT, needs acpi::init().
+    /// The PIC stays in use if there are none.
+    bool init_ioapic();
+
+    /// Loads the interrupt table on an application processor
+    void load();
+
+    void init_irq_handler(IrqHandler* handler, irq_fn fn, void* context);
+
+    /// Adds the handler to the chain of IRQ 0..15, every handler on a shared line runs for each interrupt on it.
+    /// Interrupts which no handler claims are counted as spurious.
+    bool add_irq_handler(uint8_t irq, IrqHandler* handler);
+
+    /// Once this returns the handler is not running anymore, so it must not be called from the handler itself
+    void remove_irq_handler(uint8_t irq, IrqHandler* handler);
+
+    /// Handles an exception instead of panicking, the faulting instruction is retried once the handler returns
+    void set_exception(uint8_t num, handler_fn handler);
+    void set_ipi(uint8_t vector, handler_fn handler);
+
+    /// Reserves a free vector for the handler, returns 0 if none is left. Interrupts on it are acknowledged at the local APIC.
+    /// Vectors are not shared, the handler must stay valid until free_vector().
+    uint8_t alloc_vector(IrqHandler* handler);
+    void free_vector(uint8_t vector);
 } // namespace cosmos::isr
@@ -0,0 +1,144 @@
+#include "lapic.hpp"
+
+#include "isr.hpp"
+#include "memory/virtual.hpp"
+#include "utils.hpp"
+
+namespace cosmos::lapic {
+    constexpr uint32_t MSR_APIC_BASE = 0x1B;
+    constexpr uint64_t APIC_BASE_X2APIC = 1ul << 10;
+    constexpr uint64_t APIC_BASE_ENABLE = 1ul << 11;
+    constexpr uint64_t APIC_BASE_ADDRESS_MASK = 0x000FFFFFFFFFF000;
+
+    constexpr uint32_t MSR_X2APIC_BASE = 0x800;
+    constexpr uint32_t MSR_X2APIC_ICR = 0x830;
+    constexpr uint32_t MSR_TSC_DEADLINE = 0x6E0;
+
+    constexpr uint32_t REG_ID = 0x20;
+    constexpr uint32_t REG_TPR = 0x80;
+    constexpr uint32_t REG_EOI = 0xB0;
+    constexpr uint32_t REG_SVR = 0xF0;
+    constexpr uint32_t REG_ICR_LOW = 0x300;
+    constexpr uint32_t REG_ICR_HIGH = 0x310;
+    constexpr uint32_t REG_LVT_TIMER = 0x320;
+    constexpr uint32_t REG_TIMER_INITIAL = 0x380;
+    constexpr uint32_t REG_TIMER_CURRENT = 0x390;
+    constexpr uint32_t REG_TIMER_DIVIDE = 0x3E0;
+
+    constexpr uint32_t SVR_ENABLE = 1u << 8;
+    constexpr uint32_t ICR_PENDING = 1u << 12;
+    constexpr uint32_t ICR_ASSERT = 1u << 14;
+
+    constexpr uint32_t LVT_TIMER_TSC_DEADLINE = 0b10u << 17;
+    constexpr uint32_t TIMER_DIVIDE_16 = 0b0011;
+
+    constexpr uint32_t CPUID_X2APIC = 1u << 21;
+
+    static volatile uint32_t* registers = nullptr;
+    static bool x2apic = false;
+
+    uint32_t read(const uint32_t reg) {
+        if (x2apic) return static_cast<uint32_t>(utils::read_msr(MSR_X2APIC_BASE + (reg >> 4)));
+        return registers[reg / 4];
+    }
+
+    void write(const uint32_t reg, const uint32_t value) {
+        if (x2apic) {
+            utils::write_msr(MSR_X2APIC_BASE + (reg >> 4), value);
+        } else {
+            registers[reg / 4] = value;
+        }
+    }
+
+    bool supports_x2apic() {
+        uint32_t eax, ebx, ecx, edx;
+        utils::cpuid(1, &eax, &ebx, &ecx, &edx);
+
+        return (ecx & CPUID_X2APIC) != 0;
+    }
+
+    void init() {
+        auto base = utils::read_msr(MSR_APIC_BASE);
+
+        // The enable bit has to be set before x2APIC mode can be entered
+        if ((base & APIC_BASE_ENABLE) == 0) {
+            base |= APIC_BASE_ENABLE;
+            utils::write_msr(MSR_APIC_BASE, base);
+        }
+
+        // Registers are MSRs in x2APIC mode, every access including the EOI avoids going through MMIO
+        if ((base & APIC_BASE_X2APIC) == 0 && supports_x2apic()) {
+            base |= APIC_BASE_X2APIC;
+            utils::write_msr(MSR_APIC_BASE, base);
+        }
+
+        x2apic = (base & APIC_BASE_X2APIC) != 0;
+
+        if (!x2apic && registers == nullptr) {
+            registers = reinterpret_cast<volatile uint32_t*>(memory::virt::map_mmio(base & APIC_BASE_ADDRESS_MASK, 4096));
+            if (registers == nullptr) utils::panic(nullptr, "[lapic] Failed to map registers");
+        }
+
+        write(REG_TPR, 0);
+        write(REG_SVR, SVR_ENABLE | isr::SPURIOUS);
+    }
+
+    uint32_t get_id() {
+        if (x2apic) return read(REG_ID);
+        return read(REG_ID) >> 24;
+    }
+
+    void end_irq() {
+        write(REG_EOI, 0);
+    }
+
+    void send_ipi(const uint32_t lapic_id, const uint8_t vector) {
+        const auto enabled = utils::disable_interrupts();
+
+        if (x2apic) {
+            utils::write_msr(MSR_X2APIC_ICR, (static_cast<uint64_t>(lapic_id) << 32) | ICR_ASSERT | vector);
+        } else {
+            while (read(REG_ICR_LOW) & ICR_PENDING) {
+                utils::pause();
+            }
+
+            write(REG_ICR_HIGH, lapic_id << 24);
+            write(REG_ICR_LOW, ICR_ASSERT | vector);
+        }
+
+        utils::restore_interrupts(enabled);
+    }
+
+    // Timer
+
+    bool has_tsc_deadline() {
+        uint32_t eax, ebx, ecx, edx;
+        utils::cpuid(1, &eax, &ebx, &ecx, &edx);
+
+        return (ecx & (1u << 24)) != 0;
+    }
+
+    void setup_timer(const uint8_t vector, const bool tsc_deadline) {
+        if (tsc_deadline) {
+            write(REG_LVT_TIMER, LVT_TIMER_TSC_DEADLINE | vector);
+
+            // Orders the LVT write before the first write of the deadline MSR
+            asm volatile("mfence" ::: "memory");
+        } else {
+            write(REG_TIMER_DIVIDE, TIMER_DIVIDE_16);
+            write(REG_LVT_TIMER, vector);
+        }
+    }
+
+    void start_timer(const uint32_t count) {
+        write(REG_TIMER_INITIAL, count);
+    }
+
+    uint32_t get_timer_count() {
+        return read(REG_TIMER_CURRENT);
+    }
+
+    void set_timer_deadline(const uint64_t deadline) {
+        utils::write_msr(MSR_TSC_DEADLINE, deadline);
+    }
+} // namespace cosmos::lapic
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::lapic {
+    /// Enables the local APIC of the calling cpu, the registers are mapped on the first call
+    void init();
+
+    uint32_t get_id();
+
+    void end_irq();
+
+    void send_ipi(uint32_t lapic_id, uint8_t vector);
+
+    // Timer
+
+    bool has_tsc_deadline();
+
+    /// Sets the timer of the calling cpu up in one-shot or TSC-deadline mode, it stays disarmed until started
+    void setup_timer(uint8_t vector, bool tsc_deadline);
+
+    /// One-shot mode, counts down from the given value and fires at 0, a count of 0 disarms the timer
+    void start_timer(uint32_t count);
+    uint32_t get_timer_count();
+
+    /// TSC-deadline mode, fires once the TSC reaches the deadline, a deadline of 0 disarms the timer
+    void set_timer_deadline(uint64_t deadline);
+} // namespace cosmos::lapic
@@ -76,8 +76,12 @@ namespace cosmos::pic {
         };
     }
 
-    void update() {
+    void load() {
         asm volatile("lidt %0" ::"m"(ptr) : "memory");
+    }
+
+    void update() {
+        load();
         asm volatile("sti");
     }
 
@@ -88,4 +92,11 @@ namespace cosmos::pic {
 
         utils::byte_out(MASTER_COMMAND, 0x20);
     }
+
+    void disable() {
+        utils::byte_out(MASTER_DATA, 0xFF);
+        utils::wait();
+        utils::byte_out(SLAVE_DATA, 0xFF);
+        utils::wait();
+    }
 } // namespace cosmos::pic
@@ -6,7 +6,11 @@ namespace cosmos::pic {
     void init();
 
     void set(uint8_t num, uint64_t handler, uint8_t flags);
+    void load();
     void update();
 
     void end_irq(uint8_t number);
+
+    /// Masks all IRQs, used once the I/O APIC takes over
+    void disable();
 } // namespace cosmos::pic
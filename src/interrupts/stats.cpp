@@ -0,0 +1,148 @@
+#include "stats.hpp"
+
+#include "nanoprintf.h"
+#include "utils.hpp"
+#include "vfs/devfs.hpp"
+
+#include <atomic>
+
+namespace cosmos::isr {
+    struct Counters {
+        std::atomic<uint64_t> count;
+        std::atomic<uint64_t> total_cycles;
+        std::atomic<uint64_t> max_cycles;
+        std::atomic<uint64_t> spurious;
+
+        std::atomic<uint64_t> histogram[HISTOGRAM_BUCKETS];
+    };
+
+    static Counters counters[256];
+
+    uint32_t get_bucket(const uint64_t cycles) {
+        if (cycles == 0) return 0;
+
+        const auto bucket = 63 - __builtin_clzll(cycles);
+        return bucket < static_cast<int>(HISTOGRAM_BUCKETS) ? bucket : HISTOGRAM_BUCKETS - 1;
+    }
+
+    void record(const uint8_t vector, const uint64_t cycles) {
+        auto& entry = counters[vector];
+
+        entry.count.fetch_add(1, std::memory_order_relaxed);
+        entry.total_cycles.fetch_add(cycles, std::memory_order_relaxed);
+        entry.histogram[get_bucket(cycles)].fetch_add(1, std::memory_order_relaxed);
+
+        auto max = entry.max_cycles.load(std::memory_order_relaxed);
+
+        while (cycles > max && !entry.max_cycles.compare_exchange_weak(max, cycles, std::memory_order_relaxed)) {}
+    }
+
+    void record_spurious(const uint8_t vector) {
+        counters[vector].spurious.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void get_stats(const uint8_t vector, VectorStats* stats) {
+        const auto& entry = counters[vector];
+
+        stats->count = entry.count.load(std::memory_order_relaxed);
+        stats->total_cycles = entry.total_cycles.load(std::memory_order_relaxed);
+        stats->max_cycles = entry.max_cycles.load(std::memory_order_relaxed);
+        stats->spurious = entry.spurious.load(std::memory_order_relaxed);
+
+        for (auto i = 0u; i < HISTOGRAM_BUCKETS; i++) {
+            stats->histogram[i] = entry.histogram[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Devfs
+
+    /// Enough for the counters and every histogram bucket of one vector with all numbers at their widest
+    constexpr uint32_t MAX_LINE_LENGTH = 96 + HISTOGRAM_BUCKETS * 24;
+
+    constexpr char HEADER[] = "vector count spurious avg_cycles max_cycles histogram(log2 cycles:count)\n";
+
+    /// Formats the line of one vector including its newline and returns its length, a null line only measures it
+    uint64_t format_line(char* line, const uint32_t vector, const VectorStats& stats) {
+        const auto size = line != nullptr ? MAX_LINE_LENGTH : 0;
+
+        uint64_t length = npf_snprintf(line, size, "%u %llu %llu %llu %llu", vector, static_cast<unsigned long long>(stats.count),
+                                       static_cast<unsigned long long>(stats.spurious),
+                                       static_cast<unsigned long long>(stats.total_cycles / stats.count),
+                                       static_cast<unsigned long long>(stats.max_cycles));
+
+        for (auto i = 0u; i < HISTOGRAM_BUCKETS; i++) {
+            if (stats.histogram[i] == 0) continue;
+
+            length += npf_snprintf(line != nullptr ? &line[length] : nullptr, line != nullptr ? size - length : 0, " %u:%llu", i,
+                                   static_cast<unsigned long long>(stats.histogram[i]));
+        }
+
+        if (line != nullptr) line[length] = '\n';
+        return length + 1;
+    }
+
+    /// Copies the part of the text starting at offset into out and returns its size, one line at a time without allocating.
+    /// Lines before the window are only measured and the ones after it are not formatted at all. A null out measures the whole
+    /// text instead.
+    uint64_t render(const uint64_t offset, char* out, const uint64_t length) {
+        char line[MAX_LINE_LENGTH + 1];
+
+        uint64_t position = 0;
+        uint64_t copied = 0;
+
+        for (auto vector = -1; vector < 256 && (out == nullptr || copied < length); vector++) {
+            // Lines end well before offset if even the longest possible one would
+            const auto visible = out != nullptr && position + MAX_LINE_LENGTH + 1 > offset;
+
+            const char* text = line;
+            uint64_t size;
+
+            if (vector < 0) {
+                text = HEADER;
+                size = sizeof(HEADER) - 1;
+            } else {
+                VectorStats stats;
+                get_stats(vector, &stats);
+
+                if (stats.count == 0) continue;
+                size = format_line(visible ? line : nullptr, vector, stats);
+            }
+
+            if (visible && position + size > offset) {
+                const auto start = offset > position ? offset - position : 0;
+                const auto count = utils::min(size - start, length - copied);
+
+                utils::memcpy(&out[copied], &text[start], count);
+                copied += count;
+            }
+
+            position += size;
+        }
+
+        return out != nullptr ? copied : position;
+    }
+
+    uint64_t stats_seek(vfs::File* file, const vfs::SeekType type, const int64_t offset) {
+        // Only seeking relative to the end needs to know how long the text is
+        file->seek(type == vfs::SeekType::End ? render(0, nullptr, 0) : 0, type, offset);
+        return file->cursor;
+    }
+
+    uint64_t stats_read(vfs::File* file, void* buffer, const uint64_t length) {
+        const auto size = render(file->cursor, static_cast<char*>(buffer), length);
+
+        file->cursor += size;
+        return size;
+    }
+
+    static constexpr vfs::FileOps stats_ops = {
+        .seek = stats_seek,
+        .read = stats_read,
+        .write = nullptr,
+        .ioctl = nullptr,
+    };
+
+    void init_devfs(vfs::Node* node) {
+        vfs::devfs::register_device(node, "interrupts", &stats_ops, nullptr);
+    }
+} // namespace cosmos::isr
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "vfs/types.hpp"
+
+#include <cstdint>
+
+namespace cosmos::isr {
+    /// Bucket n counts handler runs which took between 2^n and 2^(n+1) cycles
+    constexpr uint32_t HISTOGRAM_BUCKETS = 32;
+
+    struct VectorStats {
+        uint64_t count;
+        uint64_t total_cycles;
+        uint64_t max_cycles;
+
+        /// Interrupts which no handler claimed
+        uint64_t spurious;
+
+        uint64_t histogram[HISTOGRAM_BUCKETS];
+    };
+
+    /// Called by isr_handler for every interrupt which is not an exception, cycles is 0 if there was no handler
+    void record(uint8_t vector, uint64_t cycles);
+
+    /// Called by isr_handler for interrupts which no handler claimed, on top of record()
+    void record_spurious(uint8_t vector);
+
+    /// Copies the counters of one vector, they are updated concurrently so the fields might be slightly out of sync
+    void get_stats(uint8_t vector, VectorStats* stats);
+
+    /// Registers /dev/interrupts, listing the counters of all vectors which fired so far
+    void init_devfs(vfs::Node* node);
+} // namespace cosmos::isr
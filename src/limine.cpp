@@ -35,6 +35,19 @@ static volatile limine_framebuffer_request framebuffer_request = {
     .revision = 0,
 };
 
+__attribute__((unused, section(".requests"))) //
+static volatile limine_mp_request mp_request = {
+    .id = LIMINE_MP_REQUEST_ID,
+    .revision = 0,
+    .flags = 0,
+};
+
+__attribute__((unused, section(".requests"))) //
+static volatile limine_rsdp_request rsdp_request = {
+    .id = LIMINE_RSDP_REQUEST_ID,
+    .revision = 0,
+};
+
 __attribute__((unused, section(".requests_end"))) //
 static volatile uint64_t requests_end[] = LIMINE_REQUESTS_END_MARKER;
 
@@ -162,4 +175,37 @@ namespace cosmos::limine {
     const Framebuffer& get_framebuffer() {
         return fb;
     }
+
+    uint64_t get_rsdp() {
+        if (rsdp_request.response == nullptr) return 0;
+        return rsdp_request.response->address;
+    }
+
+    uint32_t get_cpu_count() {
+        if (mp_request.response == nullptr) return 1;
+        return mp_request.response->cpu_count;
+    }
+
+    uint32_t get_cpu_lapic_id(const uint32_t index) {
+        return mp_request.response->cpus[index]->lapic_id;
+    }
+
+    uint32_t get_bsp_lapic_id() {
+        if (mp_request.response == nullptr) return 0;
+        return mp_request.response->bsp_lapic_id;
+    }
+
+    static CpuEntryFn cpu_entry_fn = nullptr;
+
+    void cpu_entry(limine_mp_info* info) {
+        cpu_entry_fn(info->extra_argument);
+    }
+
+    void start_cpu(const uint32_t index, const CpuEntryFn fn, const uint64_t arg) {
+        const auto cpu = mp_request.response->cpus[index];
+        cpu_entry_fn = fn;
+
+        cpu->extra_argument = arg;
+        __atomic_store_n(&cpu->goto_address, &cpu_entry, __ATOMIC_SEQ_CST);
+    }
 } // namespace cosmos::limine
@@ -51,4 +51,17 @@ namespace cosmos::limine {
     uint64_t get_hhdm();
 
     const Framebuffer& get_framebuffer();
+
+    /// Physical address of the ACPI RSDP, 0 when the bootloader did not find one
+    uint64_t get_rsdp();
+
+    using CpuEntryFn = void (*)(uint64_t arg);
+
+    /// Returns 1 when the bootloader did not provide the MP response
+    uint32_t get_cpu_count();
+    uint32_t get_cpu_lapic_id(uint32_t index);
+    uint32_t get_bsp_lapic_id();
+
+    /// Wakes up a parked application processor, it calls fn on the stack provided by the bootloader with interrupts disabled
+    void start_cpu(uint32_t index, CpuEntryFn fn, uint64_t arg);
 } // namespace cosmos::limine
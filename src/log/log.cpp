@@ -6,6 +6,7 @@
 #include "memory/virtual.hpp"
 #include "nanoprintf.h"
 #include "serial.hpp"
+#include "sync/spinlock.hpp"
 #include "utils.hpp"
 
 #include <cstdarg>
@@ -20,8 +21,10 @@ namespace cosmos::log {
     static uint64_t size = 0;
     static uint32_t capacity = 4096;
 
+    static sync::SpinLock lock;
+
     void print(const shell::Color color, const char* str) {
-        // Serial
+        // Serial, only queued once the transmitter interrupt is set up
         serial::print(str);
 
         // Display
@@ -123,6 +126,9 @@ namespace cosmos::log {
     void println(const Type type, const char* file, const uint32_t line, const char* fmt, ...) {
         static char buffer[256];
 
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
         print_type(type);
         print_file(shell::WHITE, file);
 
@@ -137,6 +143,9 @@ namespace cosmos::log {
 
         print(shell::WHITE, buffer);
         print(shell::WHITE, "\n");
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
     }
 
     const uint8_t* get_start() {
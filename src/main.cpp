@@ -1,10 +1,14 @@
+#include "acpi/acpi.hpp"
+#include "async/executor.hpp"
 #include "devices/atapio.hpp"
 #include "devices/framebuffer.hpp"
 #include "devices/keyboard.hpp"
-#include "devices/pit.hpp"
 #include "devices/ps2kbd.hpp"
+#include "exec/exec.hpp"
+#include "fpu/fpu.hpp"
 #include "gdt.hpp"
 #include "interrupts/isr.hpp"
+#include "interrupts/stats.hpp"
 #include "limine.hpp"
 #include "log/devfs.hpp"
 #include "log/log.hpp"
@@ -15,6 +19,10 @@
 #include "scheduler/scheduler.hpp"
 #include "serial.hpp"
 #include "shell/shell.hpp"
+#include "smp/smp.hpp"
+#include "syscall/syscall.hpp"
+#include "time/clockevent.hpp"
+#include "time/clocksource.hpp"
 #include "utils.hpp"
 #include "vfs/devfs.hpp"
 #include "vfs/iso9660.hpp"
@@ -24,7 +32,7 @@
 using namespace cosmos;
 
 void init() {
-    devices::pit::start();
+    serial::init_irq();
     if (!devices::ps2kbd::init()) utils::halt();
 
     vfs::ramfs::register_filesystem();
@@ -35,14 +43,27 @@ void init() {
     const auto devfs = vfs::mount("/dev", "devfs", "");
 
     log::init_devfs(devfs);
+    isr::init_devfs(devfs);
     devices::framebuffer::init(devfs);
     devices::keyboard::init(devfs);
     devices::atapio::init(devfs);
 
+#ifdef COSMOS_SELF_CHECKS
+    async::self_check();
+#endif
+
     INFO("Initialized");
 
     log::disable_display();
-    scheduler::create_process(shell::run);
+    scheduler::create_process(shell::run, scheduler::Priority::High);
+}
+
+[[noreturn]]
+void ap_main() {
+    fpu::init_cpu();
+    syscall::init_cpu();
+    time::clockevent::init_cpu();
+    scheduler::run();
 }
 
 extern "C" [[noreturn]]
@@ -71,7 +92,20 @@ void main() {
 
     memory::heap::init();
 
-    scheduler::create_process(init, space);
+    smp::init(space);
+    fpu::init();
+    syscall::init();
+    exec::init();
+    scheduler::init();
+
+    acpi::init();
+    isr::init_ioapic();
+    time::init();
+    time::clockevent::init();
+
+    scheduler::create_process(init);
+    smp::start_aps(ap_main);
+
     scheduler::run();
 
     utils::halt();
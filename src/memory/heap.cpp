@@ -2,6 +2,7 @@
 
 #include "offsets.hpp"
 #include "physical.hpp"
+#include "sync/spinlock.hpp"
 #include "utils.hpp"
 #include "virtual.hpp"
 
@@ -17,6 +18,8 @@ namespace cosmos::memory::heap {
     static Region* tail;
     static uint64_t page_count;
 
+    static sync::SpinLock lock;
+
     bool grow() {
         const auto phys = phys::alloc_pages(1);
         if (phys == 0) return false;
@@ -74,7 +77,7 @@ namespace cosmos::memory::heap {
         return current + 1;
     }
 
-    void* alloc(const uint64_t size, const uint64_t alignment) {
+    void* alloc_locked(const uint64_t size, const uint64_t alignment) {
 #define REGION_START(region) reinterpret_cast<uint64_t>(region + 1)
 #define CALC_PADDING(region) (utils::align_up(REGION_START(region), alignment) - REGION_START(region))
 #define CHECK_REGION(region) (!region->used && region->size >= size + CALC_PADDING(region))
@@ -115,7 +118,19 @@ namespace cosmos::memory::heap {
         region->next = region->next->next;
     }
 
-    void free(void* ptr) {
+    void* alloc(const uint64_t size, const uint64_t alignment) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto ptr = alloc_locked(size, alignment);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return ptr;
+    }
+
+    void free_locked(void* ptr) {
         Region* prev = nullptr;
         Region* current = head;
 
@@ -146,4 +161,14 @@ namespace cosmos::memory::heap {
             merge_forward(current);
         }
     }
+
+    void free(void* ptr) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        free_locked(ptr);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
 } // namespace cosmos::memory::heap
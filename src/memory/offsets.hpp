@@ -5,6 +5,17 @@
 namespace cosmos::memory::virt {
     constexpr uint64_t GB = 512ul * 512ul * 4096ul;
 
+    /// User mode owns the lower half except for its last page, a system call made right below it would return to a non-canonical
+    /// address and SYSRET faults in ring 0 then
+    constexpr uint64_t USER_END = 0x00007FFFFFFFF000;
+
+    /// One PML4 slot of the lower half is shared by all spaces like the kernel half, it holds pages user mode can only read
+    constexpr uint64_t SHARED_USER = 0x00007F0000000000;
+    constexpr uint64_t SHARED_USER_END = SHARED_USER + (512ul * GB);
+
+    /// Time page starts at the shared user slot
+    constexpr uint64_t TIME_PAGE = SHARED_USER;
+
     /// Direct map starts immediately at the higher half split
     constexpr uint64_t DIRECT_MAP = 0xFFFF800000000000;
 
@@ -19,4 +30,7 @@ namespace cosmos::memory::virt {
 
     /// Kernel starts at the last 2 gB of the entire address space
     constexpr uint64_t KERNEL = 0xFFFFFFFF80000000;
+
+    /// MMIO starts 1 gB before the kernel
+    constexpr uint64_t MMIO = KERNEL - (1ul * GB);
 } // namespace cosmos::memory::virt
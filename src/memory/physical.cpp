@@ -2,6 +2,7 @@
 
 #include "limine.hpp"
 #include "log/log.hpp"
+#include "sync/spinlock.hpp"
 #include "utils.hpp"
 
 namespace cosmos::memory::phys {
@@ -11,6 +12,8 @@ namespace cosmos::memory::phys {
     static uint32_t total_pages;
     static uint32_t used_pages;
 
+    static sync::SpinLock lock;
+
     bool mark_page(const uint32_t index, const bool used) {
         uint64_t& entry = entries[index / 64u];
         const uint64_t mask = 1ull << (index % 64u);
@@ -98,7 +101,7 @@ namespace cosmos::memory::phys {
         INFO("Initialized PMM with %d pages, %d mB", total_pages, static_cast<uint64_t>(total_pages) * 4096ull / 1024ull / 1024ull);
     }
 
-    uint64_t alloc_pages(const uint32_t count) {
+    uint64_t alloc_pages_locked(const uint32_t count) {
         uint32_t first_empty = 0;
         uint32_t empty_count = 0;
 
@@ -126,12 +129,30 @@ namespace cosmos::memory::phys {
             }
         }
 
-        ERROR("Failed to allocate %d pages", count);
         return 0;
     }
 
+    uint64_t alloc_pages(const uint32_t count) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto phys = alloc_pages_locked(count);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        if (phys == 0) ERROR("Failed to allocate %d pages", count);
+        return phys;
+    }
+
     void free_pages(const uint32_t first, const uint32_t count) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
         mark_pages(first, count, false);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
     }
 
     uint32_t get_total_pages() {
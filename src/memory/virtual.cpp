@@ -4,6 +4,8 @@
 #include "log/log.hpp"
 #include "offsets.hpp"
 #include "physical.hpp"
+#include "smp/smp.hpp"
+#include "sync/spinlock.hpp"
 #include "utils.hpp"
 
 namespace cosmos::memory::virt {
@@ -65,6 +67,9 @@ namespace cosmos::memory::virt {
     constexpr uint64_t FLAG_ACCESSED = 1 << 5;
     constexpr uint64_t FLAG_DIRECT = 1 << 7;
 
+    /// Ignored by the cpu, marks pages which destroy() leaves to their owner
+    constexpr uint64_t FLAG_SHARED = 1 << 9;
+
     constexpr uint64_t ADDRESS_MASK /*************/ = 0b00000000'00000111'11111111'11111111'11111111'11111111'11110000'00000000;
     constexpr uint64_t DIRECT_PD_ADDRESS_MASK /***/ = 0b00000000'00000111'11111111'11111111'11111111'11100000'00000000'00000000;
     constexpr uint64_t DIRECT_PDP_ADDRESS_MASK /**/ = 0b00000000'00000111'11111111'11111111'11000000'00000000'00000000'00000000;
@@ -97,6 +102,10 @@ namespace cosmos::memory::virt {
         return (entry & FLAG_DIRECT) == FLAG_DIRECT;
     }
 
+    bool entry_is_shared(const uint64_t entry) {
+        return (entry & FLAG_SHARED) == FLAG_SHARED;
+    }
+
     // Space
 
     static bool first_create = true;
@@ -106,12 +115,36 @@ namespace cosmos::memory::virt {
     static uint64_t kernel_first_pml4_entry = 0;
     static uint64_t kernel_last_pml4_entry = 0;
 
+    constexpr uint32_t SHARED_USER_PML4 = SHARED_USER >> VIRT_ADDR_PML4_OFFSET;
+    static uint64_t shared_user_pml4_entry = 0;
+
     template <typename T>
     T* get_ptr_from_phys(const uint64_t phys) {
         if (switched_to_space) return reinterpret_cast<T*>(DIRECT_MAP + phys);
         return reinterpret_cast<T*>(limine::get_hhdm() + phys);
     }
 
+    /// The user flag of a table entry limits everything below it, so tables holding user pages need it too
+    uint64_t* get_child_table(uint64_t& entry, const bool user) {
+        if (entry_is_present(entry) && user) entry |= FLAG_USER;
+
+        if (!entry_is_present(entry)) {
+            const auto child_table_phys = phys::alloc_pages(1);
+
+            if (child_table_phys == 0) {
+                ERROR("Failed to allocate physical page for child table");
+                return nullptr;
+            }
+
+            const auto child_table = get_ptr_from_phys<uint64_t>(child_table_phys);
+            utils::memset(child_table, 0, 4096);
+
+            entry = (child_table_phys & ADDRESS_MASK) | FLAG_PRESENT | FLAG_WRITABLE | (user ? FLAG_USER : 0);
+        }
+
+        return get_ptr_from_phys<uint64_t>(entry & ADDRESS_MASK);
+    }
+
     bool map_kernel(const Space space) {
         for (auto i = 0u; i < limine::get_memory_range_count(); i++) {
             const auto [type, first_page, page_count] = limine::get_memory_range(i);
@@ -154,7 +187,46 @@ namespace cosmos::memory::virt {
         return true;
     }
 
+    // Space pool
+
+    /// PML4 tables of destroyed spaces with their lower half cleared, the kernel half is the same in every space
+    constexpr uint32_t SPACE_POOL_CAPACITY = 16;
+
+    static Space space_pool[SPACE_POOL_CAPACITY];
+    static uint32_t space_pool_count = 0;
+    static sync::SpinLock space_pool_lock;
+
+    Space take_pooled() {
+        const auto enabled = utils::disable_interrupts();
+        space_pool_lock.lock();
+
+        const auto space = space_pool_count > 0 ? space_pool[--space_pool_count] : 0;
+
+        space_pool_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return space;
+    }
+
+    bool put_pooled(const Space space) {
+        const auto enabled = utils::disable_interrupts();
+        space_pool_lock.lock();
+
+        const auto pooled = space_pool_count < SPACE_POOL_CAPACITY;
+        if (pooled) space_pool[space_pool_count++] = space;
+
+        space_pool_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return pooled;
+    }
+
     Space create() {
+        if (switched_to_space) {
+            const auto pooled = take_pooled();
+            if (pooled != 0) return pooled;
+        }
+
         if (first_create) {
             uint32_t eax, ebx, ecx, edx;
             utils::cpuid(0x80000001, &eax, &ebx, &ecx, &edx);
@@ -193,6 +265,18 @@ namespace cosmos::memory::virt {
 
 #undef MAP
 
+        // The first space creates the tables of the shared user slot, pages mapped into them later show up in all spaces
+        if (shared_user_pml4_entry == 0) {
+            if (get_child_table(pml4[SHARED_USER_PML4], true) == nullptr) {
+                destroy(space);
+                return 0;
+            }
+
+            shared_user_pml4_entry = pml4[SHARED_USER_PML4];
+        } else {
+            pml4[SHARED_USER_PML4] = shared_user_pml4_entry;
+        }
+
         return space;
     }
 
@@ -206,9 +290,9 @@ namespace cosmos::memory::virt {
     void destroy(const Space space) {
         const auto pml4_table = get_ptr_from_phys<uint64_t>(space);
 
-        for (auto pml4_i = 0; pml4_i < 256; pml4_i++) {
+        for (auto pml4_i = 0u; pml4_i < 256; pml4_i++) {
             const auto pml4_entry = pml4_table[pml4_i];
-            if (!entry_is_present(pml4_entry)) continue;
+            if (!entry_is_present(pml4_entry) || pml4_i == SHARED_USER_PML4) continue;
             const auto pdp_table = get_ptr_from_phys<uint64_t>(pml4_entry & ADDRESS_MASK);
 
             for (auto pdp_i = 0; pdp_i < 512; pdp_i++) {
@@ -235,7 +319,7 @@ namespace cosmos::memory::virt {
 
                     for (auto pt_i = 0; pt_i < 512; pt_i++) {
                         const auto pt_entry = pt_table[pt_i];
-                        if (!entry_is_present(pt_entry)) continue;
+                        if (!entry_is_present(pt_entry) || entry_is_shared(pt_entry)) continue;
 
                         phys::free_pages((pt_entry & ADDRESS_MASK) / 4096ul, 1);
                     }
@@ -247,45 +331,36 @@ namespace cosmos::memory::virt {
             }
 
             phys::free_pages((pml4_entry & ADDRESS_MASK) / 4096ul, 1);
+            pml4_table[pml4_i] = 0;
         }
 
-        phys::free_pages(space / 4096ul, 1);
-    }
-
-    uint64_t* get_child_table(uint64_t& entry) {
-        if (!entry_is_present(entry)) {
-            const auto child_table_phys = phys::alloc_pages(1);
-
-            if (child_table_phys == 0) {
-                ERROR("Failed to allocate physical page for child table");
-                return nullptr;
-            }
-
-            const auto child_table = get_ptr_from_phys<uint64_t>(child_table_phys);
-            utils::memset(child_table, 0, 4096);
-
-            entry = (child_table_phys & ADDRESS_MASK) | FLAG_PRESENT | FLAG_WRITABLE;
-        }
+        // Spaces created before the switch might not have their kernel half complete yet
+        if (switched_to_space && put_pooled(space)) return;
 
-        return get_ptr_from_phys<uint64_t>(entry & ADDRESS_MASK);
+        phys::free_pages(space / 4096ul, 1);
     }
 
-    bool map_pages(const Space space, uint64_t virt, uint64_t phys, uint64_t count, const bool cache_disabled) {
+    bool map(const Space space, uint64_t virt, uint64_t phys, uint64_t count, const uint64_t flags) {
         const auto pml4_table = get_ptr_from_phys<uint64_t>(space);
+        const auto user = (flags & FLAG_USER) != 0;
 
-        auto flags = FLAG_PRESENT | FLAG_WRITABLE;
-        if (cache_disabled) flags |= FLAG_CACHE_DISABLE | FLAG_WRITE_THROUGH;
+        // The kernel half is shared by all spaces
+        const auto invalidate = get_current() == space || virt * 4096ul >= DIRECT_MAP;
 
-        const auto invalidate = get_current() == space;
+        // Only replacing a present entry can leave stale translations in the TLBs of other cpus
+        const auto first_virt = virt;
+        const auto total_count = count;
+        auto replaced = false;
 
         while (count > 0) {
             const auto addr = unpack(virt * 4096);
 
-            const auto pdp_table = get_child_table(pml4_table[addr.pml4]);
+            const auto pdp_table = get_child_table(pml4_table[addr.pml4], user);
             if (pdp_table == nullptr) return false;
 
             // 1 gB
             if (gb_pages_supported && virt % (512 * 512) == 0 && phys % (512 * 512) == 0 && count >= (512 * 512)) {
+                replaced |= entry_is_present(pdp_table[addr.pdp]);
                 pdp_table[addr.pdp] = ((phys * 4096) & DIRECT_PDP_ADDRESS_MASK) | FLAG_DIRECT | flags;
                 if (invalidate) asm volatile("invlpg (%0)" ::"r"(virt * 4096ul) : "memory");
 
@@ -296,11 +371,12 @@ namespace cosmos::memory::virt {
                 continue;
             }
 
-            const auto pd_table = get_child_table(pdp_table[addr.pdp]);
+            const auto pd_table = get_child_table(pdp_table[addr.pdp], user);
             if (pd_table == nullptr) return false;
 
             // 2 mB
             if (virt % 512 == 0 && phys % 512 == 0 && count >= 512) {
+                replaced |= entry_is_present(pd_table[addr.pd]);
                 pd_table[addr.pd] = ((phys * 4096) & DIRECT_PD_ADDRESS_MASK) | FLAG_DIRECT | flags;
                 if (invalidate) asm volatile("invlpg (%0)" ::"r"(virt * 4096ul) : "memory");
 
@@ -312,9 +388,10 @@ namespace cosmos::memory::virt {
             }
 
             // 4 kB
-            const auto pt_table = get_child_table(pd_table[addr.pd]);
+            const auto pt_table = get_child_table(pd_table[addr.pd], user);
             if (pt_table == nullptr) return false;
 
+            replaced |= entry_is_present(pt_table[addr.pt]);
             pt_table[addr.pt] = ((phys * 4096) & ADDRESS_MASK) | flags;
             if (invalidate) asm volatile("invlpg (%0)" ::"r"(virt * 4096ul) : "memory");
 
@@ -323,9 +400,54 @@ namespace cosmos::memory::virt {
             count--;
         }
 
+        if (replaced) smp::flush_tlb(space, first_virt * 4096ul, total_count);
         return true;
     }
 
+    bool map_pages(const Space space, const uint64_t virt, const uint64_t phys, const uint64_t count, const bool cache_disabled) {
+        auto flags = FLAG_PRESENT | FLAG_WRITABLE;
+        if (cache_disabled) flags |= FLAG_CACHE_DISABLE | FLAG_WRITE_THROUGH;
+
+        return map(space, virt, phys, count, flags);
+    }
+
+    bool map_user_pages(const Space space, const uint64_t virt, const uint64_t phys, const uint64_t count, const bool writable,
+                        const bool shared) {
+        if (virt + count > USER_END / 4096ul || virt + count < virt) return false;
+        if (virt < SHARED_USER_END / 4096ul && virt + count > SHARED_USER / 4096ul) return false;
+
+        auto flags = FLAG_PRESENT | FLAG_USER;
+        if (writable) flags |= FLAG_WRITABLE;
+        if (shared) flags |= FLAG_SHARED;
+
+        return map(space, virt, phys, count, flags);
+    }
+
+    bool map_shared_user_page(const uint64_t virt, const uint64_t phys) {
+        if (virt < SHARED_USER / 4096ul || virt >= SHARED_USER_END / 4096ul) return false;
+        return map(get_current(), virt, phys, 1, FLAG_PRESENT | FLAG_USER | FLAG_SHARED);
+    }
+
+    static sync::SpinLock mmio_lock;
+    static uint64_t mmio_next = MMIO;
+
+    uint64_t map_mmio(const uint64_t phys, const uint64_t size) {
+        const auto first_page = phys / 4096ul;
+        const auto page_count = utils::ceil_div(phys % 4096ul + size, 4096ul);
+
+        const auto enabled = utils::disable_interrupts();
+        mmio_lock.lock();
+
+        const auto virt = mmio_next;
+        const auto mapped = map_pages(get_current(), virt / 4096ul, first_page, page_count, true);
+        if (mapped) mmio_next += page_count * 4096ul;
+
+        mmio_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return mapped ? virt + phys % 4096ul : 0;
+    }
+
     void switch_to(Space space) {
         asm volatile("mov %0, %%cr3" ::"ri"(space));
         switched_to_space = true;
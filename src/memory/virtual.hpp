@@ -29,6 +29,17 @@ namespace cosmos::memory::virt {
 
     bool map_pages(Space space, uint64_t virt, uint64_t phys, uint64_t count, bool cache_disabled);
 
+    /// Maps pages below USER_END which user mode can access, the tables on the way are made accessible as well.
+    /// Shared pages are owned by someone else and not freed together with the space.
+    bool map_user_pages(Space space, uint64_t virt, uint64_t phys, uint64_t count, bool writable, bool shared);
+
+    /// Maps a page between SHARED_USER and SHARED_USER_END which every space sees, user mode can read it
+    bool map_shared_user_page(uint64_t virt, uint64_t phys);
+
+    /// Maps a physical MMIO range uncached into the kernel half shared by all spaces
+    /// @return virtual address of the first byte or 0 if it failed to do so
+    uint64_t map_mmio(uint64_t phys, uint64_t size);
+
     void switch_to(Space space);
     bool switched();
 
@@ -2,8 +2,14 @@
 
 #include "memory/heap.hpp"
 #include "private.hpp"
+#include "sync/spinlock.hpp"
+#include "time/timer.hpp"
+#include "utils.hpp"
 
 namespace cosmos::scheduler {
+    /// Protects the signalled and waiting state of all events, signal_event() takes it from interrupt handlers on any cpu
+    static sync::SpinLock lock;
+
     EventHandle create_event(void (*destroy_fn)(uint64_t data), const uint64_t destroy_data) {
         const auto event = memory::heap::alloc<Event>();
 
@@ -11,14 +17,24 @@ namespace cosmos::scheduler {
         event->destroy_data = destroy_data;
 
         event->signalled = false;
-        event->waiting_process = nullptr;
+        event->waiters = {};
+        event->registrations = nullptr;
 
         return reinterpret_cast<uint64_t>(event);
     }
 
     bool destroy_event(const EventHandle handle) {
         const auto event = reinterpret_cast<Event*>(handle);
-        if (event->waiting_process != nullptr) return false;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto waiting = !event->waiters.empty() || event->registrations != nullptr;
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        if (waiting) return false;
 
         if (event->destroy_fn != nullptr) event->destroy_fn(event->destroy_data);
         memory::heap::free(event);
@@ -26,11 +42,56 @@ namespace cosmos::scheduler {
         return true;
     }
 
+    void notify_pollers(const Event* event);
+
+    /// Called with the lock held
+    void signal(Event* event) {
+        event->signalled = true;
+
+        for (auto waiter = event->waiters.head; waiter != nullptr; waiter = waiter->next) {
+            wake(waiter->process);
+        }
+
+        notify_pollers(event);
+    }
+
     void signal_event(const EventHandle handle) {
         const auto event = reinterpret_cast<Event*>(handle);
 
-        event->signalled = true;
-        if (event->waiting_process != nullptr) event->waiting_process->event_signalled = true;
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        signal(event);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    void signal_event_one(const EventHandle handle) {
+        const auto event = reinterpret_cast<Event*>(handle);
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        auto delivered = false;
+
+        for (auto waiter = event->waiters.head; waiter != nullptr; waiter = waiter->next) {
+            // Processes already woken by another event or their timeout would not take the signal right away
+            if (waiter->signalled || waiter->process->state != State::SuspendedEvents) continue;
+
+            waiter->signalled = true;
+            wake(waiter->process);
+
+            delivered = true;
+            break;
+        }
+
+        if (!delivered) event->signalled = true;
+
+        notify_pollers(event);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
     }
 
     bool check_event(const EventHandle handle) {
@@ -40,60 +101,291 @@ namespace cosmos::scheduler {
 
     bool reset_event(const EventHandle handle) {
         const auto event = reinterpret_cast<Event*>(handle);
-        if (event->waiting_process != nullptr) return false;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
 
         event->signalled = false;
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
         return true;
     }
 
-    uint64_t get_signalled_mask(Event** events, const uint32_t count, const bool reset_signalled) {
+    /// Collects which events are signalled, waiters is nullptr if the process did not queue up
+    uint64_t get_signalled_mask(Event** events, Waiter* waiters, const uint32_t count, const bool reset_signalled) {
         uint64_t mask = 0;
 
         for (auto i = 0u; i < count; i++) {
             const auto event = events[i];
+            const auto handed = waiters != nullptr && waiters[i].signalled;
 
-            if (event->signalled) {
+            if (waiters != nullptr) event->waiters.remove(&waiters[i]);
+
+            if (event->signalled || handed) {
                 mask |= 1ull << i;
-                if (reset_signalled) event->signalled = false;
-            }
 
-            event->waiting_process = nullptr;
+                // A signal handed to a waiter which does not consume it stays visible like with signal_event()
+                event->signalled = !reset_signalled;
+            }
         }
 
         return mask;
     }
 
-    uint64_t wait_on_events(EventHandle* handles, const uint32_t count, const bool reset_signalled) {
-        if (count > 64) return 0;
-        asm volatile("cli" ::: "memory");
+    constexpr uint32_t MAX_EVENTS = 64;
+
+    uint64_t wait(EventHandle* handles, const uint32_t count, const bool reset_signalled, const uint64_t timeout_ms) {
+        if (count > MAX_EVENTS) return 0;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
 
         const auto process = reinterpret_cast<Process*>(get_current_process());
         const auto events = reinterpret_cast<Event**>(handles);
 
+        auto signalled = timeout_ms == 0;
+
         for (auto i = 0u; i < count; i++) {
-            if (events[i]->signalled) {
-                const auto mask = get_signalled_mask(events, count, reset_signalled);
+            if (events[i]->signalled) signalled = true;
+        }
 
-                asm volatile("sti" ::: "memory");
-                return mask;
-            }
+        if (signalled) {
+            const auto mask = get_signalled_mask(events, nullptr, count, reset_signalled);
+
+            lock.unlock();
+            utils::restore_interrupts(enabled);
+
+            return mask;
         }
 
+        Waiter waiters[MAX_EVENTS];
+
         for (auto i = 0u; i < count; i++) {
-            events[i]->waiting_process = process;
+            waiters[i].process = process;
+            waiters[i].signalled = false;
+
+            events[i]->waiters.push_back(&waiters[i]);
         }
 
         process->events = events;
         process->event_count = count;
-        process->event_signalled = false;
 
         process->state = State::SuspendedEvents;
+
+        lock.unlock();
+
+        // Armed after dropping the lock since timer callbacks signal events while holding the timer lock
+        time::Timer timer;
+
+        if (timeout_ms != NO_TIMEOUT) {
+            time::init_timer(&timer, wake_process, reinterpret_cast<uint64_t>(process));
+            time::start_timer(&timer, timeout_ms, 0);
+        }
+
         yield();
-        asm volatile("cli" ::: "memory");
 
-        const auto mask = get_signalled_mask(events, count, reset_signalled);
+        if (timeout_ms != NO_TIMEOUT) {
+            time::cancel_timer(&timer);
+        }
+
+        utils::disable_interrupts();
+        lock.lock();
+
+        const auto mask = get_signalled_mask(events, waiters, count, reset_signalled);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
 
-        asm volatile("sti" ::: "memory");
         return mask;
     }
+    uint64_t wait_on_events(EventHandle* handles, const uint32_t count, const bool reset_signalled) {
+        return wait(handles, count, reset_signalled, NO_TIMEOUT);
+    }
+
+    uint64_t wait_on_events(EventHandle* handles, const uint32_t count, const bool reset_signalled, const uint64_t timeout_ms) {
+        return wait(handles, count, reset_signalled, timeout_ms);
+    }
+
+    // Poller
+
+    struct Poller;
+
+    struct Registration {
+        /// Links in the ready list of the poller
+        Registration* next;
+        Registration* prev;
+
+        /// Next registration of the same event
+        Registration* event_next;
+
+        Poller* poller;
+        Event* event;
+        uint64_t data;
+
+        bool ready;
+    };
+
+    struct Poller {
+        stl::IntrusiveList<Registration> ready;
+        uint32_t registration_count;
+
+        /// Signalled whenever the ready list stops being empty, pollers wait on it like on any other event
+        Event* ready_event;
+    };
+
+    void notify_pollers(const Event* event) {
+        for (auto registration = event->registrations; registration != nullptr; registration = registration->event_next) {
+            if (registration->ready) continue;
+
+            const auto poller = registration->poller;
+
+            registration->ready = true;
+            poller->ready.push_back(registration);
+
+            signal(poller->ready_event);
+        }
+    }
+
+    PollerHandle create_poller() {
+        const auto poller = memory::heap::alloc<Poller>();
+
+        poller->ready = {};
+        poller->registration_count = 0;
+        poller->ready_event = reinterpret_cast<Event*>(create_event(nullptr, 0));
+
+        return reinterpret_cast<uint64_t>(poller);
+    }
+
+    bool destroy_poller(const PollerHandle handle) {
+        const auto poller = reinterpret_cast<Poller*>(handle);
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto registered = poller->registration_count != 0;
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        if (registered || !destroy_event(reinterpret_cast<uint64_t>(poller->ready_event))) return false;
+
+        memory::heap::free(poller);
+        return true;
+    }
+
+    bool add_to_poller(const PollerHandle handle, const EventHandle event_handle, const uint64_t data) {
+        const auto poller = reinterpret_cast<Poller*>(handle);
+        const auto event = reinterpret_cast<Event*>(event_handle);
+
+        const auto registration = memory::heap::alloc<Registration>();
+
+        registration->poller = poller;
+        registration->event = event;
+        registration->data = data;
+        registration->ready = false;
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        for (auto other = event->registrations; other != nullptr; other = other->event_next) {
+            if (other->poller == poller) {
+                lock.unlock();
+                utils::restore_interrupts(enabled);
+
+                memory::heap::free(registration);
+                return false;
+            }
+        }
+
+        registration->event_next = event->registrations;
+        event->registrations = registration;
+        poller->registration_count++;
+
+        if (event->signalled) {
+            registration->ready = true;
+            poller->ready.push_back(registration);
+
+            signal(poller->ready_event);
+        }
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return true;
+    }
+
+    bool remove_from_poller(const PollerHandle handle, const EventHandle event_handle) {
+        const auto poller = reinterpret_cast<Poller*>(handle);
+        const auto event = reinterpret_cast<Event*>(event_handle);
+
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        // Events are watched by few pollers, walking the list of the event is cheap
+        Registration* registration = nullptr;
+
+        for (auto link = &event->registrations; *link != nullptr; link = &(*link)->event_next) {
+            if ((*link)->poller == poller) {
+                registration = *link;
+                *link = registration->event_next;
+                break;
+            }
+        }
+
+        if (registration != nullptr) {
+            if (registration->ready) poller->ready.remove(registration);
+            poller->registration_count--;
+        }
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        if (registration == nullptr) return false;
+
+        memory::heap::free(registration);
+        return true;
+    }
+
+    /// Moves up to max entries off the ready list, called with the lock held
+    uint32_t take_ready(Poller* poller, uint64_t* data, const uint32_t max, const bool reset_signalled) {
+        auto count = 0u;
+
+        while (count < max && !poller->ready.empty()) {
+            const auto registration = poller->ready.pop_front();
+            registration->ready = false;
+
+            if (reset_signalled) registration->event->signalled = false;
+            data[count++] = registration->data;
+        }
+
+        // Left over signals would make the next poll() return without anything to report
+        if (poller->ready.empty()) poller->ready_event->signalled = false;
+
+        return count;
+    }
+
+    uint32_t poll(const PollerHandle handle, uint64_t* data, const uint32_t max, const bool reset_signalled, const uint64_t timeout_ms) {
+        const auto poller = reinterpret_cast<Poller*>(handle);
+        auto ready_event = reinterpret_cast<EventHandle>(poller->ready_event);
+
+        auto timeout = timeout_ms;
+
+        for (;;) {
+            const auto enabled = utils::disable_interrupts();
+            lock.lock();
+
+            const auto count = take_ready(poller, data, max, reset_signalled);
+
+            lock.unlock();
+            utils::restore_interrupts(enabled);
+
+            if (count != 0 || timeout == 0) return count;
+            if (wait(&ready_event, 1, false, timeout) == 0) return 0;
+
+            // Another process polling the same set might take the entries first, only waiting forever retries
+            if (timeout != NO_TIMEOUT) timeout = 0;
+        }
+    }
 } // namespace cosmos::scheduler
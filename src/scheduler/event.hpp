@@ -6,11 +6,41 @@ namespace cosmos::scheduler {
     using EventHandle = uint64_t;
 
     EventHandle create_event(void (*destroy_fn)(uint64_t data), uint64_t destroy_data);
+
+    /// Fails while processes are waiting on the event or it is registered with a poller
     bool destroy_event(EventHandle handle);
 
+    /// Wakes every process waiting on the event, the event stays signalled until it is reset
     void signal_event(EventHandle handle);
+
+    /// Hands the signal to the longest waiting process and wakes only that one, signals the event if nobody waits
+    void signal_event_one(EventHandle handle);
+
     bool check_event(EventHandle handle);
     bool reset_event(EventHandle handle);
 
     uint64_t wait_on_events(EventHandle* handles, uint32_t count, bool reset_signalled);
+
+    constexpr uint64_t NO_TIMEOUT = UINT64_MAX;
+
+    /// Gives up after timeout_ms milliseconds and returns 0 then, a timeout of 0 only checks the events
+    uint64_t wait_on_events(EventHandle* handles, uint32_t count, bool reset_signalled, uint64_t timeout_ms);
+
+    // Poller
+
+    /// Persistent set of events, signalling one of them puts it on the ready list of the poller without any scanning
+    using PollerHandle = uint64_t;
+
+    PollerHandle create_poller();
+
+    /// Fails while events are still registered
+    bool destroy_poller(PollerHandle handle);
+
+    /// The data is reported by poll() once the event is signalled, an event which already is goes on the ready list right away
+    bool add_to_poller(PollerHandle handle, EventHandle event, uint64_t data);
+    bool remove_from_poller(PollerHandle handle, EventHandle event);
+
+    /// Stores the data of up to max ready events and returns how many there were. Each signal reports an event once.
+    /// Blocks while nothing is ready, gives up after timeout_ms milliseconds and returns 0 then.
+    uint32_t poll(PollerHandle handle, uint64_t* data, uint32_t max, bool reset_signalled, uint64_t timeout_ms);
 } // namespace cosmos::scheduler
@@ -0,0 +1,132 @@
+#include "futex.hpp"
+
+#include "event.hpp"
+#include "memory/virtual.hpp"
+#include "private.hpp"
+#include "stl/intrusive_list.hpp"
+#include "sync/spinlock.hpp"
+#include "time/clockevent.hpp"
+#include "time/timer.hpp"
+
+namespace cosmos::scheduler {
+    /// Lives on the stack of the waiting process, linked into the bucket its address hashes to
+    struct AddressWaiter {
+        AddressWaiter* next;
+        AddressWaiter* prev;
+
+        /// Physical address waited on, unrelated addresses share buckets
+        uint64_t key;
+        ProcessId process;
+
+        bool woken;
+    };
+
+    /// Each bucket gets its own cache line, so waiters on different addresses do not bounce each other's lock around
+    struct alignas(64) Bucket {
+        sync::SpinLock lock;
+        stl::IntrusiveList<AddressWaiter> waiters;
+    };
+
+    constexpr uint32_t BUCKET_BITS = 8;
+
+    static Bucket buckets[1 << BUCKET_BITS];
+
+    /// Returns 0 if the address is not mapped
+    uint64_t get_key(const std::atomic<uint32_t>* address) {
+        return memory::virt::get_phys(reinterpret_cast<uint64_t>(address));
+    }
+
+    Bucket& get_bucket(const uint64_t key) {
+        // Fibonacci hashing, the low bits of the key are the same for all the words in a structure
+        return buckets[((key >> 2) * 0x9E3779B97F4A7C15ull) >> (64 - BUCKET_BITS)];
+    }
+
+    WaitResult wait_on_address(const std::atomic<uint32_t>* address, const uint32_t expected, const uint64_t timeout_ms) {
+        // Reading it here maps a user page which was not touched yet, it cannot fault with the bucket lock held below
+        if (address->load() != expected) return WaitResult::Mismatch;
+        if (timeout_ms == 0) return WaitResult::TimedOut;
+
+        const auto key = get_key(address);
+        if (key == 0) return WaitResult::Mismatch;
+
+        auto& bucket = get_bucket(key);
+
+        const sync::IrqSaveGuard guard;
+        bucket.lock.lock();
+
+        // wake_address() callers change the value before taking the bucket lock, so checking under it cannot miss their wakeup
+        if (address->load() != expected) {
+            bucket.lock.unlock();
+            return WaitResult::Mismatch;
+        }
+
+        AddressWaiter waiter;
+        waiter.key = key;
+        waiter.process = get_current_process();
+        waiter.woken = false;
+
+        bucket.waiters.push_back(&waiter);
+
+        const auto deadline = timeout_ms != NO_TIMEOUT ? time::clockevent::get_ms() + timeout_ms : NO_TIMEOUT;
+
+        time::Timer timer;
+        time::init_timer(&timer, wake_process, waiter.process);
+
+        auto result = WaitResult::Woken;
+
+        // Other resume() calls can wake the process early, it only leaves once it was taken off the queue or the time is up
+        while (!waiter.woken) {
+            const auto now = deadline != NO_TIMEOUT ? time::clockevent::get_ms() : 0;
+
+            if (now >= deadline) {
+                bucket.waiters.remove(&waiter);
+                result = WaitResult::TimedOut;
+
+                break;
+            }
+
+            prepare_suspend();
+
+            // Armed after marking the process suspended, expiring before the switch then leaves it running like in sleep()
+            if (deadline != NO_TIMEOUT) time::start_timer(&timer, deadline - now, 0);
+
+            bucket.lock.unlock();
+            yield();
+            bucket.lock.lock();
+        }
+
+        bucket.lock.unlock();
+
+        if (deadline != NO_TIMEOUT) time::cancel_timer(&timer);
+        return result;
+    }
+
+    uint32_t wake_address(const std::atomic<uint32_t>* address, const uint32_t count) {
+        const auto key = get_key(address);
+        if (key == 0 || count == 0) return 0;
+
+        auto& bucket = get_bucket(key);
+        const sync::IrqLockGuard guard(bucket.lock);
+
+        auto woken = 0u;
+        auto waiter = bucket.waiters.head;
+
+        while (waiter != nullptr && woken < count) {
+            const auto next = waiter->next;
+
+            if (waiter->key == key) {
+                bucket.waiters.remove(waiter);
+
+                // The waiter only looks at its node with the bucket lock held, so it stays valid until the lock is released
+                waiter->woken = true;
+                resume(waiter->process);
+
+                woken++;
+            }
+
+            waiter = next;
+        }
+
+        return woken;
+    }
+} // namespace cosmos::scheduler
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace cosmos::scheduler {
+    enum class WaitResult : uint8_t {
+        /// Woken by wake_address(), callers check the value again since another process might have changed it back since
+        Woken,
+        /// The value was not the expected one, the process did not block
+        Mismatch,
+        TimedOut,
+    };
+
+    /// Blocks while the value at the address is the expected one, until wake_address() is called for it or timeout_ms
+    /// milliseconds passed. Waiters are queued by the physical address, so processes sharing a page through different mappings
+    /// meet each other and nothing has to be allocated. A timeout of 0 only compares the value, see scheduler::NO_TIMEOUT.
+    /// Needs process context, user addresses are faulted in before any lock is taken.
+    WaitResult wait_on_address(const std::atomic<uint32_t>* address, uint32_t expected, uint64_t timeout_ms);
+
+    /// Wakes up to count processes waiting on the address in the order they started waiting, returns how many there were
+    uint32_t wake_address(const std::atomic<uint32_t>* address, uint32_t count);
+} // namespace cosmos::scheduler
@@ -1,23 +1,85 @@
 #pragma once
 
+#include "event.hpp"
 #include "scheduler.hpp"
+#include "stl/intrusive_list.hpp"
+
+#include <atomic>
 
 namespace cosmos::scheduler {
     struct Event;
+    struct Registration;
+
+    /// Shared by a process and its threads, destroyed together with its last user
+    struct AddressSpace {
+        memory::virt::Space space;
+        std::atomic<uint32_t> references;
+
+        exec::Program* program;
+    };
 
     struct Process {
+        Process* next;
+        Process* prev;
+
+        /// Links in the ready heap of a run queue
+        Process* heap_child;
+        Process* heap_sibling;
+
+        /// Number shown to user mode, which must not learn where the process lives in the kernel heap
+        uint64_t pid;
+
+        /// Threads run thread_fn with the argument instead of fn, user processes enter user mode at user_entry instead
         ProcessFn fn;
+        ThreadFn thread_fn;
+        uint64_t arg;
+
+        uint64_t user_entry;
+        uint64_t user_stack;
+
         State state;
 
+        Priority priority;
+
+        /// Runtime in TSC cycles, the virtual one is scaled by the weight of the priority and orders the ready heap
+        uint64_t runtime;
+        uint64_t vruntime;
+
+        /// Index of the cpu whose run queue holds this process
+        uint32_t cpu;
+
+        AddressSpace* address_space;
         memory::virt::Space space;
 
+        /// Set to 1 when a joinable process exits, join() waits on its address. The joining process and the cpu freeing the stack
+        /// each hold a reference.
+        bool joinable;
+        std::atomic<uint32_t> exited;
+        std::atomic<uint32_t> references;
+        uint64_t exit_status;
+
+        vfs::File* files[MAX_FILES];
+
         void* stack;
         void* stack_top;
         uint64_t rsp;
 
+        /// Extended register state, see fpu::switch_state()
+        void* fpu_state;
+
         Event** events;
         uint32_t event_count;
-        bool event_signalled;
+    };
+
+    /// Links a waiting process into the queue of one event, lives on the stack of the process while it waits
+    struct Waiter {
+        Waiter* next;
+        Waiter* prev;
+
+        Process* process;
+
+        /// Set when signal_event_one() handed the signal to this waiter instead of the event
+        bool signalled;
     };
 
     struct Event {
@@ -25,6 +87,27 @@ namespace cosmos::scheduler {
         uint64_t destroy_data;
 
         bool signalled;
-        Process* waiting_process;
+        stl::IntrusiveList<Waiter> waiters;
+
+        /// Pollers watching this event, linked through Registration::event_next
+        Registration* registrations;
     };
+
+    /// Moves a suspended or sleeping process to the ready list of its cpu, does nothing if it is not blocked
+    void wake(Process* process);
+
+    /// Timer callback taking the process as its data
+    void wake_process(uint64_t process);
+
+    /// Creates a process in the kernel space which is not counted as alive, it must never exit
+    ProcessId create_kernel_process(ProcessFn fn, Priority priority);
+
+    /// Creates the process running queued work, called by init()
+    void start_worker();
+
+    /// Reports that the calling cpu is outside of any RCU read side section, needs preemption or interrupts disabled
+    void rcu_quiescent();
+
+    /// Creates the process freeing memory passed to rcu_free(), called by init()
+    void start_rcu();
 } // namespace cosmos::scheduler
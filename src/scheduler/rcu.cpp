@@ -0,0 +1,112 @@
+#include "rcu.hpp"
+
+#include "event.hpp"
+#include "interrupts/isr.hpp"
+#include "interrupts/lapic.hpp"
+#include "memory/heap.hpp"
+#include "private.hpp"
+#include "smp/smp.hpp"
+
+#include <atomic>
+
+namespace cosmos::scheduler {
+    // A cpu is in a quiescent state whenever its preempt count is 0, readers cannot be running on it then.
+    // Each grace period gets a number, cpus copy the latest one into their slot when the scheduler sees them quiescent.
+
+    static std::atomic<uint64_t> gp_seq = 0;
+    static std::atomic<uint64_t> cpu_seq[smp::MAX_CPUS];
+
+    void rcu_read_lock() {
+        preempt_disable();
+    }
+
+    void rcu_read_unlock() {
+        preempt_enable();
+    }
+
+    void rcu_quiescent() {
+        const auto seq = gp_seq.load();
+        auto& slot = cpu_seq[smp::get_id()];
+
+        if (slot.load(std::memory_order_relaxed) != seq) slot.store(seq, std::memory_order_release);
+    }
+
+    void synchronize_rcu() {
+        const auto target = gp_seq.fetch_add(1) + 1;
+
+        for (;;) {
+            // The calling process is outside of any read side section, so its own cpu is quiescent
+            preempt_disable();
+            rcu_quiescent();
+            preempt_enable();
+
+            auto done = true;
+
+            for (auto i = 0u; i < smp::get_count(); i++) {
+                const auto cpu = smp::get_cpu(i);
+                if (!cpu->online || cpu_seq[i].load(std::memory_order_acquire) >= target) continue;
+
+                // Idle cpus and ones running a process without ticks only report once something interrupts them
+                lapic::send_ipi(cpu->lapic_id, isr::IPI_RESCHEDULE);
+                done = false;
+            }
+
+            if (done) return;
+            sleep(1);
+        }
+    }
+
+    // Deferred frees
+
+    struct Deferred {
+        Deferred* next;
+        void* ptr;
+    };
+
+    static std::atomic<Deferred*> deferred = nullptr;
+    static EventHandle reclaim_event = 0;
+
+    void rcu_free(void* ptr) {
+        const auto entry = memory::heap::alloc<Deferred>();
+
+        // Waiting is the only option left without memory for the entry
+        if (entry == nullptr) {
+            synchronize_rcu();
+            memory::heap::free(ptr);
+            return;
+        }
+
+        entry->ptr = ptr;
+        auto head = deferred.load();
+
+        do {
+            entry->next = head;
+        } while (!deferred.compare_exchange_weak(head, entry));
+
+        if (head == nullptr) signal_event_one(reclaim_event);
+    }
+
+    void reclaimer() {
+        for (;;) {
+            wait_on_events(&reclaim_event, 1, true);
+
+            while (auto entry = deferred.exchange(nullptr)) {
+                synchronize_rcu();
+
+                while (entry != nullptr) {
+                    const auto next = entry->next;
+
+                    memory::heap::free(entry->ptr);
+                    memory::heap::free(entry);
+
+                    entry = next;
+                }
+            }
+        }
+    }
+
+    void start_rcu() {
+        reclaim_event = create_event(nullptr, 0);
+        create_kernel_process(reclaimer, Priority::Low);
+    }
+} // namespace cosmos::scheduler
@@ -0,0 +1,14 @@
+#pragma once
+
+namespace cosmos::scheduler {
+    /// Read side sections only disable preemption, so readers never touch shared cache lines. They nest and must not block.
+    void rcu_read_lock();
+    void rcu_read_unlock();
+
+    /// Waits until every read side section which was running on any cpu when it was called has finished.
+    /// Needs process context, data unlinked before the call can be freed once it returns.
+    void synchronize_rcu();
+
+    /// Frees the heap allocation once all current readers are done, for writers which do not want to wait for a grace period
+    void rcu_free(void* ptr);
+} // namespace cosmos::scheduler
@@ -1,31 +1,76 @@
 #include "scheduler.hpp"
 
+#include "exec/exec.hpp"
+#include "fpu/fpu.hpp"
+#include "futex.hpp"
+#include "gdt.hpp"
+#include "interrupts/isr.hpp"
+#include "interrupts/lapic.hpp"
 #include "memory/heap.hpp"
 #include "private.hpp"
-#include "stl/linked_list.hpp"
+#include "smp/smp.hpp"
+#include "stl/intrusive_heap.hpp"
+#include "stl/intrusive_list.hpp"
+#include "sync/spinlock.hpp"
+#include "time/clockevent.hpp"
+#include "time/timer.hpp"
 #include "utils.hpp"
+#include "vfs/vfs.hpp"
+
+#include <cstddef>
 
 namespace cosmos::scheduler {
-    static stl::LinkedList<Process> processes = {};
-    static stl::LinkedList<Process>::Iterator current = {};
+    bool vruntime_less(const Process* a, const Process* b) {
+        return a->vruntime < b->vruntime;
+    }
+
+    struct RunQueue {
+        /// Held across a context switch, the context that is switched to releases it
+        sync::SpinLock lock;
+
+        /// Runnable processes ordered by virtual runtime, the current process is not part of it
+        stl::IntrusiveHeap<Process, vruntime_less> ready;
+        std::atomic<uint32_t> ready_count;
+
+        /// Never decreases, processes joining the queue start at it so they cannot make up for time spent elsewhere
+        uint64_t min_vruntime;
+
+        /// Suspended processes, moved to the ready list by wake()
+        stl::IntrusiveList<Process> blocked;
+
+        /// Exited processes, the reaper frees them once their cpu switched away and the lock is released
+        stl::IntrusiveList<Process> exited;
+
+        /// nullptr while the cpu is idle
+        Process* current;
+        uint64_t idle_rsp;
+
+        /// TSC value at which the current process got the cpu, and at which it was last charged for its runtime
+        uint64_t slice_start;
+        uint64_t switch_tsc;
+    };
+
+    static RunQueue run_queues[smp::MAX_CPUS];
+    static std::atomic<uint64_t> alive_count = 0;
+
+    static std::atomic<uint32_t> quantum = DEFAULT_QUANTUM_MS;
 
     constexpr uint64_t STACK_SIZE = 64ul * 1024ul;
 
+    constexpr uint64_t WEIGHTS[] = { 256, 512, 1024, 2048, 4096 };
+    constexpr uint64_t NORMAL_WEIGHT = WEIGHTS[static_cast<uint8_t>(Priority::Normal)];
+
+    RunQueue& local() {
+        return run_queues[smp::get_id()];
+    }
+
+    /// Only the registers preserved across calls need saving, schedule() is an ordinary function to its callers.
+    /// Interrupts are disabled on both sides of every switch so the flags do not need saving either.
     __attribute__((naked)) void switch_to(uint64_t* old_sp, uint64_t new_sp) {
         asm volatile(R"(
-            # Save current process state to the stack
-            pushfq
-            push %rax
-            push %rbx
-            push %rcx
-            push %rdx
-            push %rsi
-            push %rdi
+            # Save callee-saved registers of the current process to the stack
             push %rbp
-            push %r8
-            push %r9
-            push %r10
-            push %r11
+            push %rbx
             push %r12
             push %r13
             push %r14
@@ -37,150 +82,816 @@ namespace cosmos::scheduler {
             # Replace the stack pointer of the current process with the new process (second argument, rsi)
             mov %rsi, %rsp
 
-            # Load new process state from the stack
+            # Load callee-saved registers of the new process from the stack
             pop %r15
             pop %r14
             pop %r13
             pop %r12
-            pop %r11
-            pop %r10
-            pop %r9
-            pop %r8
-            pop %rbp
-            pop %rdi
-            pop %rsi
-            pop %rdx
-            pop %rcx
             pop %rbx
-            pop %rax
-            popfq
+            pop %rbp
 
             # Return to the code the process was executing previously
             ret
         )");
     }
 
-    ProcessId create_process(const ProcessFn fn) {
-        const auto space = memory::virt::create();
-        return create_process(fn, space);
+    uint64_t scale_to_weight(const Process* process, const uint64_t cycles) {
+        return cycles * NORMAL_WEIGHT / WEIGHTS[static_cast<uint8_t>(process->priority)];
     }
 
-    ProcessId create_process(const ProcessFn fn, const memory::virt::Space space) {
-        const auto process = processes.push_back_alloc();
+    /// Charges the time since the last switch to the current process
+    void account(RunQueue& rq) {
+        const auto now = utils::read_tsc();
+        const auto delta = now - rq.switch_tsc;
+
+        rq.switch_tsc = now;
+
+        rq.current->runtime += delta;
+        rq.current->vruntime += scale_to_weight(rq.current, delta);
+    }
+
+    void enqueue(RunQueue& rq, Process* process) {
+        rq.ready.push(process);
+        rq.ready_count++;
+    }
+
+    Process* dequeue(RunQueue& rq) {
+        const auto process = rq.ready.pop();
+        if (process == nullptr) return nullptr;
+
+        rq.ready_count--;
+        if (process->vruntime > rq.min_vruntime) rq.min_vruntime = process->vruntime;
+
+        return process;
+    }
+
+    /// Preempts the current process once its time slice is over if anything else is ready, needs the run queue lock
+    void arm_slice(RunQueue& rq) {
+        if (rq.current == nullptr || rq.ready.empty()) return;
+
+        const auto end = rq.slice_start + time::clockevent::ms_to_tsc(quantum);
+
+        if (utils::read_tsc() >= end) {
+            smp::get_cpu()->need_resched = true;
+        } else {
+            time::clockevent::arm(end);
+        }
+    }
+
+    /// Whether a process joining the run queue should take over the cpu from its current process
+    bool should_preempt(const RunQueue& rq, const Process* process) {
+        if (rq.current == nullptr) return true;
+
+        const auto current_vruntime = rq.current->vruntime + scale_to_weight(rq.current, utils::read_tsc() - rq.switch_tsc);
+        return process->vruntime < current_vruntime;
+    }
+
+    /// Lets a process which just joined the local run queue cut in or makes sure the current one gets preempted later
+    void check_preempt(RunQueue& rq) {
+        if (rq.current == nullptr || rq.ready.empty()) return;
+
+        if (should_preempt(rq, rq.ready.top())) {
+            smp::get_cpu()->need_resched = true;
+        } else {
+            arm_slice(rq);
+        }
+    }
+
+    void on_reschedule_ipi([[maybe_unused]] isr::InterruptInfo* info) {
+        // Wakes the idle loop up from hlt, a running process gets switched away on interrupt exit if needed
+        auto& rq = local();
+
+        rq.lock.lock();
+        check_preempt(rq);
+        rq.lock.unlock();
+
+        if (smp::get_cpu()->preempt_count == 0) rcu_quiescent();
+    }
+
+    /// Locks the run queue holding the process, a ready process can be stolen by another cpu until it is locked
+    RunQueue& lock_queue_of(const Process* process) {
+        for (;;) {
+            const auto cpu = process->cpu;
+            auto& rq = run_queues[cpu];
+
+            rq.lock.lock();
+            if (process->cpu == cpu) return rq;
+            rq.lock.unlock();
+        }
+    }
+
+    void wake(Process* process) {
+        const auto enabled = utils::disable_interrupts();
+        auto& rq = lock_queue_of(process);
+
+        if (process->state == State::Suspended || process->state == State::SuspendedEvents || process->state == State::Sleeping) {
+            if (process == rq.current) {
+                // Still on its way into schedule(), it sees the new state and stays runnable
+                process->state = State::Running;
+            } else {
+                rq.blocked.remove(process);
+
+                // Sleeping does not build up credit beyond the least served ready process
+                if (process->vruntime < rq.min_vruntime) process->vruntime = rq.min_vruntime;
+
+                process->state = State::Waiting;
+                enqueue(rq, process);
+
+                if (process->cpu != smp::get_id()) {
+                    lapic::send_ipi(smp::get_cpu(process->cpu)->lapic_id, isr::IPI_RESCHEDULE);
+                } else {
+                    check_preempt(rq);
+                }
+            }
+        }
+
+        rq.lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    void kick_idle_cpu() {
+        const auto self = smp::get_id();
+
+        for (auto i = 0u; i < smp::get_count(); i++) {
+            const auto cpu = smp::get_cpu(i);
+
+            if (i != self && cpu->online && run_queues[i].current == nullptr) {
+                lapic::send_ipi(cpu->lapic_id, isr::IPI_RESCHEDULE);
+                return;
+            }
+        }
+    }
+
+    /// Drops to ring 3, the kernel stack of the process is only used again once user mode enters the kernel
+    [[noreturn]]
+    void enter_user(const uint64_t entry, const uint64_t stack) {
+        asm volatile(R"(
+            cli
+            swapgs
+
+            pushq %[ss]
+            pushq %[stack]
+            pushq $0x202
+            pushq %[cs]
+            pushq %[entry]
+
+            # Nothing of the kernel should be left in the registers
+            xor %%eax, %%eax
+            xor %%ebx, %%ebx
+            xor %%ecx, %%ecx
+            xor %%edx, %%edx
+            xor %%esi, %%esi
+            xor %%edi, %%edi
+            xor %%ebp, %%ebp
+            xor %%r8d, %%r8d
+            xor %%r9d, %%r9d
+            xor %%r10d, %%r10d
+            xor %%r11d, %%r11d
+            xor %%r12d, %%r12d
+            xor %%r13d, %%r13d
+            xor %%r14d, %%r14d
+            xor %%r15d, %%r15d
+
+            iretq
+        )" ::[ss] "i"(gdt::USER_DATA), [stack] "r"(stack), [cs] "i"(gdt::USER_CODE), [entry] "r"(entry) : "memory");
+
+        __builtin_unreachable();
+    }
+
+    [[noreturn]]
+    void start() {
+        // The lock was acquired by the context which switched to this new process
+        auto& rq = local();
+        const auto process = rq.current;
+
+        rq.lock.unlock();
+        asm volatile("sti" ::: "memory");
+
+        if (process->user_entry != 0) {
+            enter_user(process->user_entry, process->user_stack);
+        } else if (process->thread_fn != nullptr) {
+            process->thread_fn(process->arg);
+        } else {
+            process->fn();
+        }
+
+        exit();
+
+        utils::halt();
+    }
+
+    // Stack pool
+
+    /// Stacks of freed processes kept for the next ones, creating a process then does not need to go to the heap
+    constexpr uint32_t STACK_POOL_CAPACITY = 16;
+
+    static void* stack_pool[STACK_POOL_CAPACITY];
+    static uint32_t stack_pool_count = 0;
+    static sync::SpinLock stack_pool_lock;
+
+    void* alloc_stack() {
+        const auto enabled = utils::disable_interrupts();
+        stack_pool_lock.lock();
+
+        void* stack = nullptr;
+        if (stack_pool_count > 0) stack = stack_pool[--stack_pool_count];
+
+        stack_pool_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return stack != nullptr ? stack : memory::heap::alloc(STACK_SIZE, 16);
+    }
+
+    void free_stack(void* stack) {
+        const auto enabled = utils::disable_interrupts();
+        stack_pool_lock.lock();
+
+        const auto pooled = stack_pool_count < STACK_POOL_CAPACITY;
+        if (pooled) stack_pool[stack_pool_count++] = stack;
+
+        stack_pool_lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        if (!pooled) memory::heap::free(stack);
+    }
+
+    // Process
+
+    /// Numbers handed to processes in creation order, 0 is never used
+    static std::atomic<uint64_t> next_pid = 1;
+
+    Process* create(AddressSpace* address_space, const Priority priority) {
+        const auto process = memory::heap::alloc<Process>();
+
+        process->pid = next_pid++;
+
+        process->fn = nullptr;
+        process->thread_fn = nullptr;
+        process->arg = 0;
+
+        process->user_entry = 0;
+        process->user_stack = 0;
 
-        process->fn = fn;
         process->state = State::Waiting;
 
-        process->space = space;
+        process->priority = priority;
+        process->runtime = 0;
 
-        process->stack = memory::heap::alloc(STACK_SIZE, 16);
+        process->address_space = address_space;
+        process->space = address_space->space;
+
+        process->joinable = false;
+        process->exited = 0;
+        process->references = 1;
+        process->exit_status = 0;
+
+        utils::memset(process->files, 0, sizeof(process->files));
+
+        process->stack = alloc_stack();
         process->stack_top = reinterpret_cast<void*>(reinterpret_cast<uint64_t>(process->stack) + STACK_SIZE);
 
+        process->fpu_state = fpu::create_state();
+
+        process->events = nullptr;
+        process->event_count = 0;
+
         auto stack = static_cast<uint64_t*>(process->stack_top);
 
-        *--stack = reinterpret_cast<uint64_t>(exit);
-        *--stack = reinterpret_cast<uint64_t>(fn);
-        *--stack = 0x202;
+        *--stack = 0;
+        *--stack = reinterpret_cast<uint64_t>(start);
 
-        for (auto i = 0ul; i < 15; i++) {
-            *--stack = i;
+        for (auto i = 0ul; i < 6; i++) {
+            *--stack = 0;
         }
 
         process->rsp = reinterpret_cast<uint64_t>(stack);
+        return process;
+    }
+
+    ProcessId submit(Process* process) {
+        const auto enabled = utils::disable_interrupts();
+        auto& rq = local();
+        rq.lock.lock();
+
+        process->cpu = smp::get_id();
+        process->vruntime = rq.min_vruntime;
+        enqueue(rq, process);
+        arm_slice(rq);
+
+        rq.lock.unlock();
+        kick_idle_cpu();
+        utils::restore_interrupts(enabled);
 
         return reinterpret_cast<ProcessId>(process);
     }
 
+    AddressSpace* create_address_space(const memory::virt::Space space) {
+        const auto address_space = memory::heap::alloc<AddressSpace>();
+
+        address_space->space = space;
+        address_space->references = 1;
+        address_space->program = nullptr;
+
+        return address_space;
+    }
+
+    ProcessId create_process(const ProcessFn fn) {
+        return create_process(fn, Priority::Normal);
+    }
+
+    ProcessId create_process(const ProcessFn fn, const Priority priority) {
+        const auto space = memory::virt::create();
+        return create_process(fn, space, priority);
+    }
+
+    ProcessId create_process(const ProcessFn fn, const memory::virt::Space space) {
+        return create_process(fn, space, Priority::Normal);
+    }
+
+    ProcessId create_process(const ProcessFn fn, const memory::virt::Space space, const Priority priority) {
+        const auto process = create(create_address_space(space), priority);
+        process->fn = fn;
+
+        alive_count++;
+        return submit(process);
+    }
+
+    ProcessId create_user_process(const memory::virt::Space space, exec::Program* program, const uint64_t entry, const uint64_t stack) {
+        const auto address_space = create_address_space(space);
+        address_space->program = program;
+
+        const auto process = create(address_space, Priority::Normal);
+
+        process->user_entry = entry;
+        process->user_stack = stack;
+
+        process->joinable = true;
+        process->references = 2;
+
+        alive_count++;
+        return submit(process);
+    }
+
+    ProcessId create_thread(const ThreadFn fn, const uint64_t arg) {
+        const auto parent = reinterpret_cast<Process*>(get_current_process());
+        parent->address_space->references++;
+
+        const auto thread = create(parent->address_space, parent->priority);
+
+        thread->thread_fn = fn;
+        thread->arg = arg;
+
+        thread->joinable = true;
+        thread->references = 2;
+
+        alive_count++;
+        return submit(thread);
+    }
+
+    void release(Process* process) {
+        if (--process->references == 0) memory::heap::free(process);
+    }
+
+    uint64_t join(const ProcessId id) {
+        const auto thread = reinterpret_cast<Process*>(id);
+
+        while (thread->exited.load() == 0) {
+            wait_on_address(&thread->exited, 0, NO_TIMEOUT);
+        }
+
+        const auto status = thread->exit_status;
+        release(thread);
+
+        return status;
+    }
+
     ProcessId get_current_process() {
-        return reinterpret_cast<ProcessId>(*current);
+        preempt_disable();
+        const auto process = local().current;
+        preempt_enable();
+
+        return reinterpret_cast<ProcessId>(process);
     }
 
     State get_process_state(const ProcessId id) {
         return reinterpret_cast<Process*>(id)->state;
     }
 
-    void move_next() {
-        ++current;
-
-        if (current == stl::LinkedList<Process>::end()) {
-            current = processes.begin();
+    bool is_on_cpu(const ProcessId id) {
+        for (auto i = 0u; i < smp::get_count(); i++) {
+            // Only compared, so a process which exited in the meantime is never touched
+            if (reinterpret_cast<ProcessId>(__atomic_load_n(&run_queues[i].current, __ATOMIC_RELAXED)) == id) return true;
         }
+
+        return false;
     }
 
-    void yield() {
-        if (current->state == State::Running) {
-            current->state = State::Waiting;
+    uint64_t get_process_pid(const ProcessId id) {
+        return reinterpret_cast<Process*>(id)->pid;
+    }
+
+    Priority get_process_priority(const ProcessId id) {
+        return reinterpret_cast<Process*>(id)->priority;
+    }
+
+    void set_process_priority(const ProcessId id, const Priority priority) {
+        const auto process = reinterpret_cast<Process*>(id);
+
+        const auto enabled = utils::disable_interrupts();
+        auto& rq = lock_queue_of(process);
+
+        // Time already run is charged at the old weight
+        if (process == rq.current) account(rq);
+        process->priority = priority;
+
+        rq.lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    uint64_t get_process_runtime(const ProcessId id) {
+        const auto process = reinterpret_cast<Process*>(id);
+
+        const auto enabled = utils::disable_interrupts();
+        auto& rq = lock_queue_of(process);
+
+        if (process == rq.current) account(rq);
+        const auto runtime = process->runtime;
+
+        rq.lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return runtime;
+    }
+
+    void destroy(Process* process) {
+        const auto address_space = process->address_space;
+
+        if (--address_space->references == 0) {
+            // Pages shared through the program are skipped by destroy(), they go away with its last user
+            memory::virt::destroy(address_space->space);
+            if (address_space->program != nullptr) exec::release(address_space->program);
+
+            memory::heap::free(address_space);
         }
 
-        const auto old_process = *current;
+        free_stack(process->stack);
+        fpu::destroy_state(process->fpu_state);
+        release(process);
+    }
+
+    // Reaper
 
-        asm volatile("cli" ::: "memory");
+    /// Processes which called exit() and were not freed yet
+    static std::atomic<uint32_t> exiting = 0;
+    static EventHandle reaper_event = 0;
+
+    /// Moves the processes which finished switching away for the last time out of the run queues
+    void collect_exited(stl::IntrusiveList<Process>& dead) {
+        for (auto i = 0u; i < smp::get_count(); i++) {
+            auto& rq = run_queues[i];
 
-        move_next();
+            const auto enabled = utils::disable_interrupts();
+            rq.lock.lock();
+
+            while (const auto process = rq.exited.pop_front()) {
+                dead.push_back(process);
+            }
 
+            rq.lock.unlock();
+            utils::restore_interrupts(enabled);
+        }
+    }
+
+    /// Frees exited processes off the scheduling path, tearing down a space walks all of its tables
+    void reaper() {
         for (;;) {
-            if (current->state == State::Exited) {
-                if (processes.single_item()) {
-                    utils::panic(nullptr, "[scheduler] All processes exited, stopping");
-                }
+            wait_on_events(&reaper_event, 1, true);
 
-                if (*current != old_process) {
-                    memory::virt::destroy(current->space);
-                    memory::heap::free(current->stack);
+            while (exiting > 0) {
+                stl::IntrusiveList<Process> dead;
+                collect_exited(dead);
 
-                    processes.remove_free(current);
-                    continue;
+                while (const auto process = dead.pop_front()) {
+                    destroy(process);
+                    exiting--;
                 }
-            }
 
-            if (current->state == State::Waiting || (current->state == State::SuspendedEvents && current->event_signalled)) {
-                break;
+                // The remaining ones are still on their way out of their cpu
+                if (exiting > 0) yield();
             }
+        }
+    }
+
+    ProcessId create_kernel_process(const ProcessFn fn, const Priority priority) {
+        const auto process = create(create_address_space(smp::get_kernel_space()), priority);
+        process->fn = fn;
+
+        return submit(process);
+    }
+
+    void init() {
+        isr::set_ipi(isr::IPI_RESCHEDULE, on_reschedule_ipi);
 
-            if (*current == old_process) {
-                asm volatile("sti; hlt; cli" ::: "memory");
+        reaper_event = create_event(nullptr, 0);
+        create_kernel_process(reaper, Priority::Low);
+
+        start_worker();
+        start_rcu();
+    }
+
+    /// Takes the least served ready process out of the run queue of the busiest other cpu.
+    /// Its virtual runtime is made relative to the minimum of the queue it came from.
+    Process* steal() {
+        const auto self = smp::get_id();
+
+        auto victim_id = self;
+        auto victim_count = 0u;
+
+        for (auto i = 0u; i < smp::get_count(); i++) {
+            const auto count = run_queues[i].ready_count.load();
+
+            if (i != self && smp::get_cpu(i)->online && count > victim_count) {
+                victim_id = i;
+                victim_count = count;
             }
+        }
+
+        if (victim_id == self) return nullptr;
+
+        auto& victim = run_queues[victim_id];
+        if (!victim.lock.try_lock()) return nullptr;
 
-            move_next();
+        const auto process = victim.ready.pop();
+
+        if (process != nullptr) {
+            victim.ready_count--;
+            process->vruntime -= victim.min_vruntime;
         }
 
-        current->state = State::Running;
+        victim.lock.unlock();
+        return process;
+    }
+
+    /// Entries from user mode start on top of the kernel stack of the process, nothing of it is in use while it runs there
+    void load_kernel_stack(const Process* process) {
+        const auto top = reinterpret_cast<uint64_t>(process->stack_top);
+
+        smp::get_cpu()->kernel_stack = top;
+        gdt::set_kernel_stack(top);
+    }
+
+    /// Threads of the same process share their space, switching between them keeps the TLB entries
+    void switch_space(const memory::virt::Space space) {
+        if (memory::virt::get_current() != space) memory::virt::switch_to(space);
+    }
+
+    /// Switches away from the current process, called with interrupts disabled and the run queue lock held.
+    /// Returns with the lock released once the process gets picked again, possibly on a different cpu.
+    void schedule(RunQueue& rq) {
+        const auto old_process = rq.current;
+
+        account(rq);
+        rcu_quiescent();
 
-        if (old_process != *current) {
-            memory::virt::switch_to(current->space);
-            switch_to(&old_process->rsp, current->rsp);
+        switch (old_process->state) {
+            case State::Running:
+            case State::Waiting:
+                old_process->state = State::Waiting;
+                enqueue(rq, old_process);
+                break;
+            case State::Suspended:
+            case State::SuspendedEvents:
+            case State::Sleeping:
+                rq.blocked.push_back(old_process);
+                break;
+            case State::Exited:
+                rq.exited.push_back(old_process);
+                break;
         }
 
-        asm volatile("sti" ::: "memory");
+        const auto next = dequeue(rq);
+
+        rq.slice_start = rq.switch_tsc;
+        smp::get_cpu()->need_resched = false;
+
+        if (next == old_process) {
+            old_process->state = State::Running;
+            arm_slice(rq);
+
+            rq.lock.unlock();
+            return;
+        }
+
+        if (next != nullptr) {
+            rq.current = next;
+            next->state = State::Running;
+            arm_slice(rq);
+
+            switch_space(next->space);
+            load_kernel_stack(next);
+            fpu::switch_state(old_process->fpu_state, next->fpu_state);
+            switch_to(&old_process->rsp, next->rsp);
+        } else {
+            rq.current = nullptr;
+
+            switch_space(smp::get_kernel_space());
+            fpu::switch_state(old_process->fpu_state, nullptr);
+            switch_to(&old_process->rsp, rq.idle_rsp);
+        }
+
+        // The process might have been resumed on a different cpu, release the lock the switching context held
+        local().lock.unlock();
+    }
+
+    void yield() {
+        const sync::IrqSaveGuard guard;
+
+        auto& rq = local();
+        rq.lock.lock();
+        schedule(rq);
     }
 
     void exit() {
-        current->state = State::Exited;
+        exit(0);
+    }
+
+    void exit(const uint64_t status) {
+        if (--alive_count == 0) {
+            utils::panic(nullptr, "[scheduler] All processes exited, stopping");
+        }
+
+        const auto process = reinterpret_cast<Process*>(get_current_process());
+
+        for (const auto file : process->files) {
+            if (file != nullptr) vfs::close_file(file);
+        }
+
+        process->exit_status = status;
+
+        if (process->joinable) {
+            process->exited = 1;
+            wake_address(&process->exited, 1);
+        }
+
+        exiting++;
+        signal_event(reaper_event);
+
+        asm volatile("cli" ::: "memory");
+        local().current->state = State::Exited;
         yield();
     }
 
+    exec::Program* get_program() {
+        return reinterpret_cast<Process*>(get_current_process())->address_space->program;
+    }
+
+    vfs::File** get_files() {
+        return reinterpret_cast<Process*>(get_current_process())->files;
+    }
+
     void suspend() {
-        current->state = State::Suspended;
+        const sync::IrqSaveGuard guard;
+
+        local().current->state = State::Suspended;
         yield();
     }
 
+    void prepare_suspend() {
+        local().current->state = State::Suspended;
+    }
+
     void resume(const ProcessId id) {
         const auto process = reinterpret_cast<Process*>(id);
+        if (process->state == State::Suspended) wake(process);
+    }
+
+    void wake_process(const uint64_t process) {
+        wake(reinterpret_cast<Process*>(process));
+    }
+
+    void sleep(const uint64_t ms) {
+        const sync::IrqSaveGuard guard;
+        const auto process = local().current;
+
+        time::Timer timer;
+        time::init_timer(&timer, wake_process, reinterpret_cast<uint64_t>(process));
+
+        // Expiring before the switch is fine, wake() then leaves the process running
+        process->state = State::Sleeping;
+        time::start_timer(&timer, ms, 0);
+
+        yield();
+        time::cancel_timer(&timer);
+    }
+
+    // Preemption
 
-        if (process->state == State::Suspended) {
-            process->state = State::Waiting;
+    void set_quantum(const uint32_t ms) {
+        quantum = ms > 0 ? ms : 1;
+    }
+
+    uint32_t get_quantum() {
+        return quantum;
+    }
+
+    // The count is changed with a single instruction on the per-cpu data. Finding the cpu first and then changing its count could
+    // be preempted in between, and the process might continue on another cpu while the old one is left with the change.
+
+    constexpr uint64_t PREEMPT_COUNT_OFFSET = offsetof(smp::Cpu, preempt_count);
+
+    void preempt_disable() {
+        asm volatile("incl %%gs:%c0" ::"i"(PREEMPT_COUNT_OFFSET) : "memory");
+    }
+
+    void preempt_enable() {
+        asm volatile("decl %%gs:%c0" ::"i"(PREEMPT_COUNT_OFFSET) : "memory");
+
+        // The process can be preempted again, so the cpu is looked up afresh
+        const auto cpu = smp::get_cpu();
+
+        if (cpu->preempt_count == 0 && cpu->need_resched && utils::interrupts_enabled()) {
+            yield();
         }
     }
 
+    void tick() {
+        auto& rq = local();
+
+        rq.lock.lock();
+        arm_slice(rq);
+        rq.lock.unlock();
+
+        if (smp::get_cpu()->preempt_count == 0) rcu_quiescent();
+    }
+
+    void on_interrupt_exit() {
+        // IRQs can arrive before the per-cpu data of the bootstrap processor is set up
+        if (smp::get_count() == 0) return;
+
+        const auto cpu = smp::get_cpu();
+        if (!cpu->need_resched || cpu->preempt_count > 0) return;
+
+        auto& rq = local();
+        rq.lock.lock();
+
+        // The idle loop picks up new work by itself and a process which is already switching away is left alone
+        if (rq.current == nullptr || rq.current->state != State::Running) {
+            cpu->need_resched = false;
+            rq.lock.unlock();
+            return;
+        }
+
+        // Interrupts stay disabled until the interrupted context is restored by iretq
+        schedule(rq);
+    }
+
+    // Idle loop
+
     void run() {
         asm volatile("cli" ::: "memory");
 
-        current = processes.begin();
-        uint64_t old;
+        auto& rq = local();
+        const auto self = smp::get_id();
 
-        current->state = State::Running;
+        for (;;) {
+            rq.lock.lock();
 
-        memory::virt::switch_to(current->space);
-        switch_to(&old, current->rsp);
+            auto next = dequeue(rq);
+
+            if (next == nullptr) {
+                rq.lock.unlock();
+                next = steal();
+                rq.lock.lock();
+
+                if (next != nullptr) {
+                    next->cpu = self;
+                    next->vruntime += rq.min_vruntime;
+                }
+            }
+
+            if (next != nullptr) {
+                rq.current = next;
+                next->state = State::Running;
+
+                rq.switch_tsc = utils::read_tsc();
+                rq.slice_start = rq.switch_tsc;
+                smp::get_cpu()->need_resched = false;
+                arm_slice(rq);
+
+                switch_space(next->space);
+                load_kernel_stack(next);
+                fpu::switch_state(nullptr, next->fpu_state);
+                switch_to(&rq.idle_rsp, next->rsp);
+
+                // Back in the idle loop, the process which switched to it still holds the lock
+                rq.lock.unlock();
+                continue;
+            }
+
+            rq.lock.unlock();
+            rcu_quiescent();
+
+            asm volatile("sti; hlt; cli" ::: "memory");
+        }
     }
 } // namespace cosmos::scheduler
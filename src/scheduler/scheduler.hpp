@@ -4,32 +4,113 @@
 
 #include <cstdint>
 
+namespace cosmos::exec {
+    struct Program;
+} // namespace cosmos::exec
+
+namespace cosmos::vfs {
+    struct File;
+} // namespace cosmos::vfs
+
 namespace cosmos::scheduler {
     using ProcessFn = void (*)();
+    using ThreadFn = void (*)(uint64_t arg);
 
     enum class State : uint8_t {
         Waiting,
         Running,
         Suspended,
         SuspendedEvents,
+        Sleeping,
         Exited,
     };
 
+    /// Higher priorities get a larger share of the cpu, each step doubles the weight of a process
+    enum class Priority : uint8_t {
+        Lowest,
+        Low,
+        Normal,
+        High,
+        Highest,
+    };
+
     using ProcessId = uint64_t;
 
+    constexpr uint32_t DEFAULT_QUANTUM_MS = 10;
+
+    /// Files a user process can have open at the same time
+    constexpr uint32_t MAX_FILES = 16;
+
+    /// Registers the reschedule IPI, needs to be called after smp::init()
     void init();
 
     ProcessId create_process(ProcessFn fn);
+    ProcessId create_process(ProcessFn fn, Priority priority);
     ProcessId create_process(ProcessFn fn, memory::virt::Space space);
+    ProcessId create_process(ProcessFn fn, memory::virt::Space space, Priority priority);
+
+    /// Creates a thread sharing the address space of the current process, the space lives until its last thread exited
+    ProcessId create_thread(ThreadFn fn, uint64_t arg);
+
+    /// Creates a process starting in user mode at entry with the given stack, it has to be joined like a thread. Pages which are
+    /// not mapped in the space yet are loaded from the program when they are first touched, it can be nullptr if all of them are.
+    /// The space takes over the reference to the program.
+    ProcessId create_user_process(memory::virt::Space space, exec::Program* program, uint64_t entry, uint64_t stack);
+
+    /// Blocks until the thread or user process exited and releases it, every one has to be joined exactly once.
+    /// Returns the status it passed to exit().
+    uint64_t join(ProcessId id);
 
     ProcessId get_current_process();
     State get_process_state(ProcessId id);
 
+    /// Whether the process is what some cpu runs right now. Does not look at the process itself, so it may have exited already.
+    bool is_on_cpu(ProcessId id);
+
+    /// Unique number of the process which is safe to give to user mode, unlike the ProcessId
+    uint64_t get_process_pid(ProcessId id);
+
+    Priority get_process_priority(ProcessId id);
+    void set_process_priority(ProcessId id, Priority priority);
+
+    /// Time the process spent running so far, in TSC cycles
+    uint64_t get_process_runtime(ProcessId id);
+
     void yield();
     void exit();
+    void exit(uint64_t status);
+
+    /// Program the address space of the current process was loaded from, nullptr if there is none
+    exec::Program* get_program();
+
+    /// Open files of the current process indexed by the handles user mode refers to them with, closed when it exits
+    vfs::File** get_files();
 
     void suspend();
     void resume(ProcessId id);
 
+    /// Marks the current process as suspended without switching away, needs interrupts disabled until the following yield().
+    /// A resume() in between leaves the process running, so wait queues can release their lock before yielding.
+    void prepare_suspend();
+
+    /// Blocks the current process for at least the given number of milliseconds
+    void sleep(uint64_t ms);
+
+    /// Sets how long a process runs before the timer preempts it in favour of the next one
+    void set_quantum(uint32_t ms);
+    uint32_t get_quantum();
+
+    /// Regions between these calls are not preempted, they nest and must not yield
+    void preempt_disable();
+    void preempt_enable();
+
+    /// Called by the timer interrupt of each cpu, checks whether the time slice of the current process is over
+    void tick();
+
+    /// Called on the way out of every IRQ once it was acknowledged, switches away if a reschedule is pending
+    void on_interrupt_exit();
+
+    /// Runs the idle loop of the calling cpu, picking up processes from its run queue or stealing them from busier cpus
+    [[noreturn]]
     void run();
 } // namespace cosmos::scheduler
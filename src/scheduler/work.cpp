@@ -0,0 +1,67 @@
+#include "work.hpp"
+
+#include "event.hpp"
+#include "private.hpp"
+
+namespace cosmos::scheduler {
+    /// Pushed onto by any cpu and interrupt handler, the worker takes the whole list at once so there is no ABA problem
+    static std::atomic<Work*> pending = nullptr;
+    static EventHandle work_event = 0;
+
+    void init_work(Work* work, const WorkFn fn, const uint64_t data) {
+        work->next = nullptr;
+
+        work->fn = fn;
+        work->data = data;
+
+        work->queued = false;
+    }
+
+    bool queue_work(Work* work) {
+        if (work->queued.exchange(true)) return false;
+
+        auto head = pending.load();
+
+        do {
+            work->next = head;
+        } while (!pending.compare_exchange_weak(head, work));
+
+        // Only the first item needs to wake the worker, it drains everything queued until then
+        if (head == nullptr) signal_event_one(work_event);
+
+        return true;
+    }
+
+    void worker() {
+        for (;;) {
+            wait_on_events(&work_event, 1, true);
+
+            while (auto work = pending.exchange(nullptr)) {
+                // The list is in reverse order of queueing
+                Work* ordered = nullptr;
+
+                while (work != nullptr) {
+                    const auto next = work->next;
+
+                    work->next = ordered;
+                    ordered = work;
+
+                    work = next;
+                }
+
+                while (ordered != nullptr) {
+                    const auto next = ordered->next;
+                    ordered->queued = false;
+
+                    ordered->fn(ordered->data);
+                    ordered = next;
+                }
+            }
+        }
+    }
+
+    void start_worker() {
+        work_event = create_event(nullptr, 0);
+        create_kernel_process(worker, Priority::Highest);
+    }
+} // namespace cosmos::scheduler
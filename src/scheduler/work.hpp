@@ -0,0 +1,25 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace cosmos::scheduler {
+    using WorkFn = void (*)(uint64_t data);
+
+    /// Owned by the caller like time::Timer, it can be queued again as soon as its function started running
+    struct Work {
+        Work* next;
+
+        WorkFn fn;
+        uint64_t data;
+
+        std::atomic<bool> queued;
+    };
+
+    void init_work(Work* work, WorkFn fn, uint64_t data);
+
+    /// Hands the work to the worker process, safe to call from interrupt handlers. Queueing is lock-free, only the first item
+    /// after the worker drained the queue signals it. Items run one after another in the order they were queued.
+    /// Returns false if the work is already queued.
+    bool queue_work(Work* work);
+} // namespace cosmos::scheduler
@@ -1,12 +1,32 @@
 #include "serial.hpp"
+
+#include "interrupts/isr.hpp"
+#include "smp/smp.hpp"
+#include "stl/ring.hpp"
 #include "utils.hpp"
 #include <nanoprintf.h>
 
+#include <atomic>
+
 namespace cosmos::serial {
     constexpr uint16_t COM1 = 0x3F8;
+    constexpr uint8_t IRQ = 4;
+
+    /// Bytes the transmitter takes at once whenever it reports being empty
+    constexpr uint32_t FIFO_SIZE = 16;
 
     static bool DISABLED = true;
 
+    constexpr uint32_t NO_CPU = ~0u;
+
+    /// Filled by print() on any cpu, only the cpu stored in transmitter takes bytes out
+    static stl::MpscRing<char, 4096> transmit_ring;
+    static std::atomic<uint32_t> transmitter = NO_CPU;
+
+    /// Until the interrupt is set up print() itself waits for the transmitter to take all queued bytes
+    static std::atomic<bool> irq_enabled = false;
+    static isr::IrqHandler irq_handler;
+
     bool init() {
         utils::byte_out(COM1 + 1, 0x00); // Disable all interrupts
         utils::byte_out(COM1 + 3, 0x80); // Enable DLAB (set baud rate divisor)
@@ -41,24 +61,103 @@ namespace cosmos::serial {
         }
     }
 
-    void print(const char* str) {
+    /// Everything runs on the bootstrap processor until its per-cpu data is set up
+    uint32_t get_cpu_id() {
+        return smp::get_count() != 0 ? smp::get_id() : 0;
+    }
+
+    /// Moves queued bytes into the transmitter, unless another cpu already does. Without wait it stops once the FIFO is full
+    /// and the interrupt continues when it is empty again.
+    void transmit(const bool wait) {
+        do {
+            auto expected = NO_CPU;
+            if (!transmitter.compare_exchange_strong(expected, get_cpu_id(), std::memory_order_acquire)) return;
+
+            char chunk[FIFO_SIZE];
+
+            for (;;) {
+                if (!is_transmit_empty()) {
+                    if (!wait) break;
+                    wait_for_transmit();
+                }
+
+                const auto count = transmit_ring.pop(chunk, FIFO_SIZE);
+                if (count == 0) break;
+
+                for (auto i = 0u; i < count; i++) {
+                    utils::byte_out(COM1, chunk[i]);
+                }
+            }
+
+            transmitter.store(NO_CPU, std::memory_order_release);
+
+            // Bytes queued or an interrupt which came in while this cpu was transmitting would otherwise be left behind
+        } while (!transmit_ring.empty() && (wait || is_transmit_empty()));
+    }
+
+    isr::IrqResult on_interrupt([[maybe_unused]] isr::InterruptInfo* info, [[maybe_unused]] void* context) {
+        // Bit 0 of the interrupt identification is clear while an interrupt is pending, reading it acknowledges an empty transmitter
+        if ((utils::byte_in(COM1 + 2) & 0b1) != 0) return isr::IrqResult::None;
+
+        transmit(false);
+        return isr::IrqResult::Handled;
+    }
+
+    void init_irq() {
         if (DISABLED) return;
 
-        auto i = 0;
+        isr::init_irq_handler(&irq_handler, on_interrupt, nullptr);
+        if (!isr::add_irq_handler(IRQ, &irq_handler)) return;
+
+        irq_enabled = true;
+
+        // Interrupt whenever the transmitter holding register is empty, which it already is unless something is being sent
+        utils::byte_out(COM1 + 1, 0x02);
+        transmit(false);
+    }
+
+    /// Queues bytes, falling back to waiting for the transmitter while the ring is full
+    void enqueue(const char* data, const uint32_t length) {
+        auto queued = transmit_ring.push(data, length);
+
+        while (queued < length) {
+            // An interrupt or exception which came in while this cpu was transmitting cannot wait for it to empty the ring, the
+            // rest is written out directly and might end up between bytes which were queued earlier
+            if (transmitter.load(std::memory_order_acquire) == get_cpu_id()) {
+                for (auto i = queued; i < length; i++) {
+                    wait_for_transmit();
+                    utils::byte_out(COM1, data[i]);
+                }
+
+                return;
+            }
 
-        for (;;) {
-            const auto ch = str[i++];
+            transmit(true);
+            utils::pause();
 
-            if (ch == '\0') break;
+            queued += transmit_ring.push(data + queued, length - queued);
+        }
+    }
 
-            if (ch == '\n') {
-                wait_for_transmit();
-                utils::byte_out(COM1, '\r');
+    void print(const char* str) {
+        if (DISABLED) return;
+
+        char chunk[64];
+        auto size = 0u;
+
+        for (auto i = 0u; str[i] != '\0'; i++) {
+            if (size + 2 > sizeof(chunk)) {
+                enqueue(chunk, size);
+                size = 0;
             }
 
-            wait_for_transmit();
-            utils::byte_out(COM1, ch);
+            if (str[i] == '\n') chunk[size++] = '\r';
+            chunk[size++] = str[i];
         }
+
+        if (size > 0) enqueue(chunk, size);
+
+        transmit(!irq_enabled.load(std::memory_order_relaxed));
     }
 
     void printf(const char* fmt, ...) {
@@ -3,6 +3,10 @@
 namespace cosmos::serial {
     bool init();
 
+    /// Lets the transmitter interrupt send queued bytes instead of print() waiting for them, needs isr::init_ioapic()
+    void init_irq();
+
+    /// Queues the string without waiting for the transmitter once init_irq() was called
     void print(const char* str);
 
     void printf(const char* fmt, ...);
@@ -1,8 +1,11 @@
 #include "commands.hpp"
 
+#include "exec/exec.hpp"
+#include "interrupts/stats.hpp"
 #include "memory/heap.hpp"
 #include "memory/physical.hpp"
 #include "shell.hpp"
+#include "syscall/syscall.hpp"
 #include "utils.hpp"
 #include "vfs/path.hpp"
 #include "vfs/vfs.hpp"
@@ -46,6 +49,50 @@ namespace cosmos::shell {
         print(GRAY, " mB\n");
     }
 
+    void interrupts([[maybe_unused]] const char* args) {
+        for (auto vector = 0u; vector < 256; vector++) {
+            isr::VectorStats stats;
+            isr::get_stats(vector, &stats);
+
+            if (stats.count == 0) continue;
+
+            printf("%3u", vector);
+            print(GRAY, ": ");
+            printf("%llu", static_cast<unsigned long long>(stats.count));
+            print(GRAY, " calls, ");
+            printf("%llu", static_cast<unsigned long long>(stats.spurious));
+            print(GRAY, " spurious, avg ");
+            printf("%llu", static_cast<unsigned long long>(stats.total_cycles / stats.count));
+            print(GRAY, " max ");
+            printf("%llu", static_cast<unsigned long long>(stats.max_cycles));
+            print(GRAY, " cycles\n    ");
+
+            // Only the buckets which were hit, as log2 of the cycles
+            for (auto i = 0u; i < isr::HISTOGRAM_BUCKETS; i++) {
+                if (stats.histogram[i] == 0) continue;
+                printf(GRAY, "2^%u:", i);
+                printf("%llu ", static_cast<unsigned long long>(stats.histogram[i]));
+            }
+
+            print("\n");
+        }
+    }
+
+    void syscall_bench([[maybe_unused]] const char* args) {
+        constexpr uint64_t iterations = 100'000;
+        const auto cycles = syscall::benchmark(iterations);
+
+        if (cycles == 0) {
+            print(RED, "Failed to run the benchmark\n");
+            return;
+        }
+
+        printf("%llu", static_cast<unsigned long long>(cycles));
+        print(GRAY, " cycles per system call round trip, ");
+        printf("%llu", static_cast<unsigned long long>(iterations));
+        print(GRAY, " calls\n");
+    }
+
     void touch(const char* args) {
         const auto space = utils::str_index_of(args, ' ');
 
@@ -258,8 +305,28 @@ namespace cosmos::shell {
         memory::heap::free(target_path);
     }
 
+    void exec_cmd(const char* args) {
+        char* resolved = resolve_or_default(args);
+        if (resolved == nullptr) return;
+
+        const auto process = exec::run(resolved);
+        memory::heap::free(resolved);
+
+        if (process == 0) {
+            print(RED, "Failed to load program\n");
+            return;
+        }
+
+        const auto status = scheduler::join(process);
+
+        print(GRAY, "Exited with status ");
+        printf("%llu\n", static_cast<unsigned long long>(status));
+    }
+
     static constexpr Command commands[] = {
         { "meminfo", "Display memory information", meminfo },
+        { "interrupts", "Display interrupt counts and handler latencies", interrupts },
+        { "syscall-bench", "Measure the system call round trip from user mode", syscall_bench },
         { "touch", "Creates and writes a file", touch },
         { "cat", "Reads a file", cat },
         { "ls", "Lists children of a directory", ls },
@@ -269,6 +336,7 @@ namespace cosmos::shell {
         { "rmdir", "Remove empty directory", rmdir_cmd },
         { "cd", "Change directory", cd },
         { "mount", "Mounts a filesystem to a directory", mount_cmd },
+        { "exec", "Runs an ELF executable and waits for it to exit", exec_cmd },
         { "help", "Display all available commands", help },
     };
 
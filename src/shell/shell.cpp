@@ -325,20 +325,46 @@ namespace cosmos::shell {
         }
     }
 
+    /// Keyboard events are read in batches, the ones after the Enter finishing a line are kept for the next one
+    static devices::keyboard::Event kb_batch[16];
+    static uint32_t kb_batch_start = 0;
+    static uint32_t kb_batch_count = 0;
+
+    bool next_event(vfs::File* kbdev, devices::keyboard::Event& event) {
+        if (kb_batch_start == kb_batch_count) {
+            kb_batch_start = 0;
+            kb_batch_count = kbdev->ops->read(kbdev, kb_batch, sizeof(kb_batch)) / sizeof(devices::keyboard::Event);
+
+            if (kb_batch_count == 0) return false;
+        }
+
+        event = kb_batch[kb_batch_start++];
+        return true;
+    }
+
     void read(char* buffer, const uint32_t length) {
         using namespace devices::keyboard;
 
         const auto kbdev = vfs::open_file("/dev/keyboard", vfs::Mode::Read);
-        const auto kb_event = kbdev->ops->ioctl(kbdev, IOCTL_CREATE_EVENT, 0);
+        const auto kb_event = kbdev->ops->ioctl(kbdev, IOCTL_GET_EVENT, 0);
         kbdev->ops->ioctl(kbdev, IOCTL_RESET_BUFFER, 0);
 
         auto size = 0u;
 
+        // Left over from the previous line, so they are handled before waiting for new keys
+        auto pending = kb_batch_start != kb_batch_count;
+
         for (;;) {
             fill_cell(cursor_visible ? 0xFFFFFFFF : 0xFF000000);
 
-            scheduler::EventHandle handles[] = { cursor_blink_event, kb_event };
-            const auto signalled = scheduler::wait_on_events(handles, 2, true);
+            uint64_t signalled = 0b10;
+
+            if (!pending) {
+                scheduler::EventHandle handles[] = { cursor_blink_event, kb_event };
+                signalled = scheduler::wait_on_events(handles, 2, true);
+            }
+
+            pending = false;
 
             if (signalled & 0b01) {
                 cursor_visible = !cursor_visible;
@@ -348,7 +374,7 @@ namespace cosmos::shell {
                 Event event;
                 auto exit = false;
 
-                while (kbdev->ops->read(kbdev, &event, sizeof(Event)) != 0) {
+                while (next_event(kbdev, event)) {
                     if ((event.key == Key::Enter || event.key == Key::NumEnter) && event.press) {
                         if (size > 0) {
                             exit = true;
@@ -383,7 +409,6 @@ namespace cosmos::shell {
             }
         }
 
-        scheduler::destroy_event(kb_event);
         vfs::close_file(kbdev);
 
         if (cursor_visible) fill_cell(0xFF000000);
@@ -0,0 +1,181 @@
+#include "smp.hpp"
+
+#include "gdt.hpp"
+#include "interrupts/isr.hpp"
+#include "interrupts/lapic.hpp"
+#include "limine.hpp"
+#include "log/log.hpp"
+#include "memory/offsets.hpp"
+#include "sync/spinlock.hpp"
+#include "utils.hpp"
+
+namespace cosmos::smp {
+    constexpr uint32_t MSR_GS_BASE = 0xC0000101;
+
+    constexpr uint64_t START_TIMEOUT = 100'000'000;
+
+    static Cpu cpus[MAX_CPUS];
+    static uint32_t cpu_count = 0;
+    static std::atomic<uint32_t> online_count = 0;
+
+    static memory::virt::Space kernel_space;
+    static void (*ap_entry_fn)();
+
+    // TLB shootdown
+
+    struct Shootdown {
+        memory::virt::Space space;
+        uint64_t virt;
+        uint64_t count;
+    };
+
+    static sync::SpinLock shootdown_lock;
+    static Shootdown shootdown;
+    static std::atomic<uint32_t> shootdown_pending = 0;
+
+    void handle_shootdown() {
+        const auto cpu = get_cpu();
+        if (!cpu->tlb_flush_pending.exchange(false)) return;
+
+        if (shootdown.virt >= memory::virt::DIRECT_MAP || memory::virt::get_current() == shootdown.space) {
+            if (shootdown.count > 64) {
+                memory::virt::switch_to(memory::virt::get_current());
+            } else {
+                for (auto i = 0ul; i < shootdown.count; i++) {
+                    asm volatile("invlpg (%0)" ::"r"(shootdown.virt + i * 4096ul) : "memory");
+                }
+            }
+        }
+
+        shootdown_pending.fetch_sub(1);
+    }
+
+    void on_shootdown_ipi([[maybe_unused]] isr::InterruptInfo* info) {
+        handle_shootdown();
+    }
+
+    void flush_tlb(const memory::virt::Space space, const uint64_t virt, const uint64_t count) {
+        if (online_count.load() <= 1) return;
+
+        const auto enabled = utils::disable_interrupts();
+
+        // Another cpu might be waiting on us while we wait for the lock
+        while (!shootdown_lock.try_lock()) {
+            handle_shootdown();
+            utils::pause();
+        }
+
+        shootdown = { .space = space, .virt = virt, .count = count };
+
+        const auto self = get_cpu();
+        auto targets = 0u;
+
+        for (auto i = 0u; i < cpu_count; i++) {
+            if (&cpus[i] != self && cpus[i].online) targets++;
+        }
+
+        shootdown_pending = targets;
+
+        for (auto i = 0u; i < cpu_count; i++) {
+            const auto cpu = &cpus[i];
+            if (cpu == self || !cpu->online) continue;
+
+            cpu->tlb_flush_pending = true;
+            lapic::send_ipi(cpu->lapic_id, isr::IPI_TLB_SHOOTDOWN);
+        }
+
+        while (shootdown_pending.load() != 0) {
+            utils::pause();
+        }
+
+        shootdown_lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    // Init
+
+    Cpu* add_cpu(const uint32_t lapic_id) {
+        const auto cpu = &cpus[cpu_count];
+
+        cpu->self = cpu;
+        cpu->kernel_stack = 0;
+        cpu->user_stack = 0;
+        cpu->id = cpu_count;
+        cpu->lapic_id = lapic_id;
+        cpu->online = false;
+        cpu->tlb_flush_pending = false;
+        cpu->preempt_count = 0;
+        cpu->need_resched = false;
+        cpu->fpu_state = nullptr;
+        cpu->fpu_loaded = false;
+
+        cpu_count++;
+        return cpu;
+    }
+
+    void init_cpu(Cpu* cpu) {
+        utils::write_msr(MSR_GS_BASE, reinterpret_cast<uint64_t>(cpu));
+        gdt::load_tss(cpu->id);
+        lapic::init();
+
+        cpu->online = true;
+        online_count++;
+    }
+
+    void init(const memory::virt::Space kernel_space) {
+        smp::kernel_space = kernel_space;
+
+        isr::set_ipi(isr::IPI_TLB_SHOOTDOWN, on_shootdown_ipi);
+
+        init_cpu(add_cpu(limine::get_bsp_lapic_id()));
+    }
+
+    void ap_main(const uint64_t arg) {
+        const auto cpu = reinterpret_cast<Cpu*>(arg);
+
+        gdt::load();
+        isr::load();
+        memory::virt::switch_to(kernel_space);
+
+        init_cpu(cpu);
+        INFO("CPU %d online", cpu->id);
+
+        ap_entry_fn();
+        utils::halt();
+    }
+
+    void start_aps(void (*entry_fn)()) {
+        ap_entry_fn = entry_fn;
+
+        const auto bsp_lapic_id = limine::get_bsp_lapic_id();
+
+        for (auto i = 0u; i < limine::get_cpu_count() && cpu_count < MAX_CPUS; i++) {
+            const auto lapic_id = limine::get_cpu_lapic_id(i);
+            if (lapic_id == bsp_lapic_id) continue;
+
+            limine::start_cpu(i, ap_main, reinterpret_cast<uint64_t>(add_cpu(lapic_id)));
+        }
+
+        for (auto i = 0ul; i < START_TIMEOUT && online_count.load() < cpu_count; i++) {
+            utils::pause();
+        }
+
+        if (online_count.load() < cpu_count) {
+            WARN("Only %d out of %d cpus came online", online_count.load(), cpu_count);
+        }
+
+        INFO("Started %d cpus", online_count.load());
+    }
+
+    Cpu* get_cpu(const uint32_t id) {
+        return &cpus[id];
+    }
+
+    uint32_t get_count() {
+        return cpu_count;
+    }
+
+    memory::virt::Space get_kernel_space() {
+        return kernel_space;
+    }
+} // namespace cosmos::smp
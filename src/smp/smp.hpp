@@ -0,0 +1,57 @@
+#pragma once
+
+#include "memory/virtual.hpp"
+
+#include <atomic>
+#include <cstdint>
+
+namespace cosmos::smp {
+    constexpr uint32_t MAX_CPUS = 32;
+
+    struct Cpu {
+        /// Needs to be the first field, get_cpu() reads it through %gs:0
+        Cpu* self;
+
+        /// Read by the system call entry through %gs:8 and %gs:16, the stack of the current process and the user one saved on entry
+        uint64_t kernel_stack;
+        uint64_t user_stack;
+
+        uint32_t id;
+        uint32_t lapic_id;
+
+        std::atomic<bool> online;
+        std::atomic<bool> tlb_flush_pending;
+
+        /// Only touched by the cpu itself, the scheduler does not preempt while it is not 0
+        uint32_t preempt_count;
+        std::atomic<bool> need_resched;
+
+        /// Save area of the running process, its registers are only loaded once it uses them
+        void* fpu_state;
+        bool fpu_loaded;
+    };
+
+    /// Sets up the per-cpu data of the bootstrap processor, idle cpus run in the given kernel space
+    void init(memory::virt::Space kernel_space);
+
+    /// Starts all application processors, each of them calls entry_fn once it is online
+    void start_aps(void (*entry_fn)());
+
+    inline Cpu* get_cpu() {
+        Cpu* cpu;
+        asm volatile("mov %%gs:0, %0" : "=r"(cpu));
+        return cpu;
+    }
+
+    inline uint32_t get_id() {
+        return get_cpu()->id;
+    }
+
+    Cpu* get_cpu(uint32_t id);
+    uint32_t get_count();
+
+    memory::virt::Space get_kernel_space();
+
+    /// Invalidates a range of pages on all other cpus which might have the translations cached
+    void flush_tlb(memory::virt::Space space, uint64_t virt, uint64_t count);
+} // namespace cosmos::smp
@@ -0,0 +1,87 @@
+#pragma once
+
+namespace cosmos::stl {
+    /// Pairing heap threaded through the items themselves, T needs `T* heap_child` and `T* heap_sibling` members.
+    /// Less has to be a strict ordering, items comparing equal come out in no particular order.
+    template <typename T, bool (*Less)(const T*, const T*)>
+    struct IntrusiveHeap {
+        T* root = nullptr;
+
+        [[nodiscard]]
+        bool empty() const {
+            return root == nullptr;
+        }
+
+        [[nodiscard]]
+        T* top() const {
+            return root;
+        }
+
+        void push(T* item) {
+            item->heap_child = nullptr;
+            item->heap_sibling = nullptr;
+
+            root = meld(root, item);
+        }
+
+        T* pop() {
+            const auto item = root;
+            if (item == nullptr) return nullptr;
+
+            root = meld_pairs(item->heap_child);
+            item->heap_child = nullptr;
+
+            return item;
+        }
+
+    private:
+        /// Links two roots, the larger one becomes the first child of the smaller one
+        static T* meld(T* a, T* b) {
+            if (a == nullptr) return b;
+            if (b == nullptr) return a;
+
+            if (Less(b, a)) {
+                const auto tmp = a;
+                a = b;
+                b = tmp;
+            }
+
+            b->heap_sibling = a->heap_child;
+            a->heap_child = b;
+
+            return a;
+        }
+
+        /// Melds the children of a popped root in pairs from left to right, then the pairs from right to left
+        static T* meld_pairs(T* first) {
+            T* pairs = nullptr;
+
+            while (first != nullptr) {
+                const auto a = first;
+                const auto b = a->heap_sibling;
+
+                first = b != nullptr ? b->heap_sibling : nullptr;
+
+                a->heap_sibling = nullptr;
+                if (b != nullptr) b->heap_sibling = nullptr;
+
+                // Prepending reverses the pairs, so walking the list afterwards goes from right to left
+                const auto pair = meld(a, b);
+                pair->heap_sibling = pairs;
+                pairs = pair;
+            }
+
+            T* result = nullptr;
+
+            while (pairs != nullptr) {
+                const auto next = pairs->heap_sibling;
+                pairs->heap_sibling = nullptr;
+
+                result = meld(result, pairs);
+                pairs = next;
+            }
+
+            return result;
+        }
+    };
+} // namespace cosmos::stl
@@ -0,0 +1,66 @@
+#pragma once
+
+namespace cosmos::stl {
+    /// Doubly linked list threaded through the items themselves, T needs `T* next` and `T* prev` members.
+    /// The list never allocates, so items keep their address while moving between lists.
+    template <typename T>
+    struct IntrusiveList {
+        T* head = nullptr;
+        T* tail = nullptr;
+
+        [[nodiscard]]
+        bool empty() const {
+            return head == nullptr;
+        }
+
+        void push_back(T* item) {
+            item->next = nullptr;
+            item->prev = tail;
+
+            if (tail != nullptr) {
+                tail->next = item;
+            } else {
+                head = item;
+            }
+
+            tail = item;
+        }
+
+        void push_front(T* item) {
+            item->next = head;
+            item->prev = nullptr;
+
+            if (head != nullptr) {
+                head->prev = item;
+            } else {
+                tail = item;
+            }
+
+            head = item;
+        }
+
+        void remove(T* item) {
+            if (item->prev != nullptr) {
+                item->prev->next = item->next;
+            } else {
+                head = item->next;
+            }
+
+            if (item->next != nullptr) {
+                item->next->prev = item->prev;
+            } else {
+                tail = item->prev;
+            }
+
+            item->next = nullptr;
+            item->prev = nullptr;
+        }
+
+        T* pop_front() {
+            const auto item = head;
+            if (item != nullptr) remove(item);
+
+            return item;
+        }
+    };
+} // namespace cosmos::stl
@@ -2,7 +2,12 @@
 
 #include "memory/heap.hpp"
 
+#include <cstddef>
+
 namespace cosmos::stl {
+    /// Singly linked list owning its items. Writers need to be serialized, but links are published with release stores and
+    /// followed with acquire loads, so readers can walk the list while it changes as long as unlinked nodes are freed after an
+    /// RCU grace period.
     template <typename T>
     struct LinkedList {
         struct Node {
@@ -28,14 +33,14 @@ namespace cosmos::stl {
 
             Iterator& operator++() {
                 prev = node;
-                node = node->next;
+                node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
                 return *this;
             }
 
             T* operator++(int) {
                 const auto item = &node->item;
                 prev = node;
-                node = node->next;
+                node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
                 return item;
             }
         };
@@ -53,33 +58,55 @@ namespace cosmos::stl {
             return head != nullptr && head == tail;
         }
 
-        T* push_back_alloc(const std::size_t additional_size = 0) {
+        static Node* node_of(T* item) {
+            return reinterpret_cast<Node*>(reinterpret_cast<uint8_t*>(item) - offsetof(Node, item));
+        }
+
+        /// Allocates an item without linking it, so it can be filled in before push_back() makes it visible to readers
+        T* alloc(const std::size_t additional_size = 0) {
             const auto node = static_cast<Node*>(memory::heap::alloc(sizeof(Node) + additional_size, alignof(Node)));
+            if (node == nullptr) return nullptr;
+
+            node->next = nullptr;
+            return &node->item;
+        }
+
+        void push_back(T* item) {
+            const auto node = node_of(item);
+            node->next = nullptr;
 
             if (head == nullptr) {
-                head = node;
                 tail = node;
+                __atomic_store_n(&head, node, __ATOMIC_RELEASE);
             } else {
-                tail->next = node;
+                __atomic_store_n(&tail->next, node, __ATOMIC_RELEASE);
                 tail = node;
             }
+        }
 
-            node->next = nullptr;
-            return &node->item;
+        T* push_back_alloc(const std::size_t additional_size = 0) {
+            const auto item = alloc(additional_size);
+            if (item != nullptr) push_back(item);
+
+            return item;
         }
 
-        void remove_free(Node* prev, Node* node) {
+        /// Takes the node out of the list without freeing it, readers which are still at it continue with the nodes after it
+        void unlink(Node* prev, Node* node) {
             if (prev != nullptr) {
-                prev->next = node->next;
+                __atomic_store_n(&prev->next, node->next, __ATOMIC_RELEASE);
             }
 
             if (head == node) {
-                head = node->next;
+                __atomic_store_n(&head, node->next, __ATOMIC_RELEASE);
             }
             if (tail == node) {
                 tail = prev;
             }
+        }
 
+        void remove_free(Node* prev, Node* node) {
+            unlink(prev, node);
             memory::heap::free(node);
         }
 
@@ -90,7 +117,7 @@ namespace cosmos::stl {
         }
 
         Iterator begin() const {
-            return { nullptr, head };
+            return { nullptr, __atomic_load_n(&head, __ATOMIC_ACQUIRE) };
         }
 
         static Iterator end() {
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace cosmos::stl {
+    constexpr uint32_t CACHE_LINE = 64;
+
+    /// Bounded queue between one producer and one consumer which never takes a lock, so either side can be an interrupt handler.
+    /// Positions run freely and wrap at 2^32, the capacity has to be a power of two to keep slots in place across the wrap.
+    /// Both indices and the items get their own cache lines, producer and consumer only share the line of the other's index.
+    template <typename T, uint32_t N>
+    struct SpscRing {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "Ring capacity must be a power of two");
+
+        /// Next position to write, only changed by the producer
+        alignas(CACHE_LINE) std::atomic<uint32_t> head = 0;
+
+        /// Next position to read, only changed by the consumer
+        alignas(CACHE_LINE) std::atomic<uint32_t> tail = 0;
+
+        alignas(CACHE_LINE) T items[N] = {};
+
+        /// Producer side, copies as many items as there is room for and returns how many that were
+        uint32_t push(const T* src, uint32_t count) {
+            const auto position = head.load(std::memory_order_relaxed);
+            const auto free = N - (position - tail.load(std::memory_order_acquire));
+
+            if (count > free) count = free;
+
+            for (auto i = 0u; i < count; i++) {
+                items[(position + i) & (N - 1)] = src[i];
+            }
+
+            head.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        bool push(const T& item) {
+            return push(&item, 1) == 1;
+        }
+
+        /// Consumer side, copies up to max items out and returns how many there were
+        uint32_t pop(T* dst, const uint32_t max) {
+            const auto position = tail.load(std::memory_order_relaxed);
+
+            auto count = head.load(std::memory_order_acquire) - position;
+            if (count > max) count = max;
+
+            for (auto i = 0u; i < count; i++) {
+                dst[i] = items[(position + i) & (N - 1)];
+            }
+
+            tail.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        bool pop(T& item) {
+            return pop(&item, 1) == 1;
+        }
+
+        [[nodiscard]]
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+    };
+
+    /// Like SpscRing but any number of producers can push at the same time, including interrupt handlers interrupting another
+    /// producer. They reserve slots by moving the head and publish each item through the sequence of its slot, the consumer
+    /// stops at the first slot which is reserved but not written yet.
+    template <typename T, uint32_t N>
+    struct MpscRing {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "Ring capacity must be a power of two");
+
+        struct Slot {
+            /// Position of the item plus one once it is written, so zeroed slots are empty
+            std::atomic<uint32_t> sequence = 0;
+            T item = {};
+        };
+
+        /// Next position to reserve, shared by the producers
+        alignas(CACHE_LINE) std::atomic<uint32_t> head = 0;
+
+        /// Next position to read, only changed by the consumer
+        alignas(CACHE_LINE) std::atomic<uint32_t> tail = 0;
+
+        alignas(CACHE_LINE) Slot slots[N] = {};
+
+        /// Producer side, copies as many items as there is room for and returns how many that were. Items of a single call end
+        /// up next to each other.
+        uint32_t push(const T* src, const uint32_t count) {
+            auto position = head.load(std::memory_order_relaxed);
+            uint32_t reserved;
+
+            do {
+                // A stale head makes this garbage, but then the exchange fails and it is computed again
+                const auto free = N - (position - tail.load(std::memory_order_acquire));
+
+                reserved = count < free ? count : free;
+                if (reserved == 0) return 0;
+            } while (!head.compare_exchange_weak(position, position + reserved, std::memory_order_relaxed));
+
+            for (auto i = 0u; i < reserved; i++) {
+                auto& slot = slots[(position + i) & (N - 1)];
+
+                slot.item = src[i];
+                slot.sequence.store(position + i + 1, std::memory_order_release);
+            }
+
+            return reserved;
+        }
+
+        bool push(const T& item) {
+            return push(&item, 1) == 1;
+        }
+
+        /// Consumer side, copies up to max published items out and returns how many there were
+        uint32_t pop(T* dst, const uint32_t max) {
+            const auto position = tail.load(std::memory_order_relaxed);
+            auto count = 0u;
+
+            while (count < max) {
+                const auto& slot = slots[(position + count) & (N - 1)];
+                if (slot.sequence.load(std::memory_order_acquire) != position + count + 1) break;
+
+                dst[count++] = slot.item;
+            }
+
+            if (count > 0) tail.store(position + count, std::memory_order_release);
+            return count;
+        }
+
+        bool pop(T& item) {
+            return pop(&item, 1) == 1;
+        }
+
+        /// Consumer side, whether the next item is not published yet
+        [[nodiscard]]
+        bool empty() const {
+            const auto position = tail.load(std::memory_order_acquire);
+            return slots[position & (N - 1)].sequence.load(std::memory_order_acquire) != position + 1;
+        }
+    };
+} // namespace cosmos::stl
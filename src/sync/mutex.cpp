@@ -0,0 +1,163 @@
+#include "mutex.hpp"
+
+#include "smp/smp.hpp"
+#include "utils.hpp"
+
+namespace cosmos::sync {
+    /// Roughly the length of a short critical section, sleeping and waking up again costs more than this
+    constexpr uint32_t SPIN_LIMIT = 1000;
+
+    // Wait queue
+
+    /// Needs the queue lock held with interrupts disabled
+    void enqueue(WaitQueue& queue, WaitNode& node) {
+        node.process = scheduler::get_current_process();
+        node.woken = false;
+
+        queue.waiters.push_back(&node);
+    }
+
+    /// Needs the node queued and the queue lock held with interrupts disabled, the lock is released while the process is blocked
+    void sleep(WaitQueue& queue, const WaitNode& node) {
+        // Other resume() calls can wake the process early, it only leaves once the node was taken off the queue
+        while (!node.woken) {
+            scheduler::prepare_suspend();
+            queue.lock.unlock();
+
+            scheduler::yield();
+
+            queue.lock.lock();
+        }
+    }
+
+    void block(WaitQueue& queue, WaitNode& node) {
+        enqueue(queue, node);
+        sleep(queue, node);
+    }
+
+    /// Needs the queue lock held with interrupts disabled
+    bool wake_one(WaitQueue& queue) {
+        const auto node = queue.waiters.pop_front();
+        if (node == nullptr) return false;
+
+        // The waiter only looks at its node with the queue lock held, so it stays valid until the lock is released
+        node->woken = true;
+        scheduler::resume(node->process);
+
+        return true;
+    }
+
+    // Mutex
+
+    void Mutex::lock() {
+        const auto self = scheduler::get_current_process();
+        if (owner.load(std::memory_order_relaxed) == self) utils::panic(nullptr, "[sync] Mutex locked recursively");
+
+        // Only worth it while the owner runs on another cpu and can release it soon, a blocked or preempted one cannot
+        if (smp::get_count() > 1) {
+            scheduler::ProcessId spun_on = 0;
+
+            for (auto i = 0u; i < SPIN_LIMIT; i++) {
+                if (try_lock()) return;
+
+                const auto holder = owner.load(std::memory_order_relaxed);
+
+                if (holder != 0) {
+                    if (spun_on == 0) spun_on = holder;
+
+                    // Changing hands without this process getting it means it is contended, sleeping beats competing again
+                    if (holder != spun_on || !scheduler::is_on_cpu(holder)) break;
+                }
+
+                utils::pause();
+            }
+        }
+
+        const IrqSaveGuard guard;
+        queue.lock.lock();
+
+        WaitNode node;
+
+        // unlock() releases the mutex before taking the queue lock, so checking under it cannot miss the wakeup
+        while (!try_lock()) {
+            block(queue, node);
+        }
+
+        queue.lock.unlock();
+    }
+
+    bool Mutex::try_lock() {
+        scheduler::ProcessId expected = 0;
+        return owner.load(std::memory_order_relaxed) == 0 &&
+               owner.compare_exchange_strong(expected, scheduler::get_current_process(), std::memory_order_acquire, std::memory_order_relaxed);
+    }
+
+    void Mutex::unlock() {
+        if (!is_held()) utils::panic(nullptr, "[sync] Mutex unlocked by a process which does not own it");
+
+        owner.store(0, std::memory_order_release);
+
+        const IrqLockGuard guard(queue.lock);
+        wake_one(queue);
+    }
+
+    bool Mutex::is_held() const {
+        return owner.load(std::memory_order_relaxed) == scheduler::get_current_process();
+    }
+
+    // Semaphore
+
+    void Semaphore::wait() {
+        const IrqLockGuard guard(queue.lock);
+        WaitNode node;
+
+        while (count == 0) {
+            block(queue, node);
+        }
+
+        count--;
+    }
+
+    bool Semaphore::try_wait() {
+        const IrqLockGuard guard(queue.lock);
+        if (count == 0) return false;
+
+        count--;
+        return true;
+    }
+
+    void Semaphore::signal() {
+        const IrqLockGuard guard(queue.lock);
+
+        count++;
+        wake_one(queue);
+    }
+
+    // Condition variable
+
+    void CondVar::wait(Mutex& mutex) {
+        {
+            const IrqLockGuard guard(queue.lock);
+            WaitNode node;
+
+            // Queued before the mutex is released, so a signal() by the next owner reaches this waiter
+            enqueue(queue, node);
+            mutex.unlock();
+
+            sleep(queue, node);
+        }
+
+        mutex.lock();
+    }
+
+    void CondVar::signal() {
+        const IrqLockGuard guard(queue.lock);
+        wake_one(queue);
+    }
+
+    void CondVar::broadcast() {
+        const IrqLockGuard guard(queue.lock);
+
+        while (wake_one(queue)) {}
+    }
+} // namespace cosmos::sync
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "scheduler/scheduler.hpp"
+#include "spinlock.hpp"
+#include "stl/intrusive_list.hpp"
+
+#include <atomic>
+
+namespace cosmos::sync {
+    /// Blocked process linked into a wait queue, lives on its stack while it waits
+    struct WaitNode {
+        WaitNode* next;
+        WaitNode* prev;
+
+        scheduler::ProcessId process;
+        bool woken;
+    };
+
+    struct WaitQueue {
+        SpinLock lock;
+        stl::IntrusiveList<WaitNode> waiters;
+    };
+
+    /// Sleeping lock for process context. Contenders spin for a short while in case the owner is about to release it, then block.
+    struct Mutex {
+        /// 0 while unlocked
+        std::atomic<scheduler::ProcessId> owner = 0;
+        WaitQueue queue;
+
+        void lock();
+        bool try_lock();
+
+        /// Panics if the calling process does not own the mutex
+        void unlock();
+
+        bool is_held() const;
+    };
+
+    struct Semaphore {
+        uint64_t count;
+        WaitQueue queue;
+
+        constexpr explicit Semaphore(const uint64_t count = 0) : count(count) {}
+
+        /// Blocks until the count is above 0 and takes one from it
+        void wait();
+        bool try_wait();
+
+        void signal();
+    };
+
+    /// Waiters hold the mutex when calling wait() and get it back before returning, wakeups can be spurious
+    struct CondVar {
+        WaitQueue queue;
+
+        void wait(Mutex& mutex);
+
+        void signal();
+        void broadcast();
+    };
+
+    struct MutexGuard {
+        Mutex& mutex;
+
+        explicit MutexGuard(Mutex& mutex) : mutex(mutex) {
+            mutex.lock();
+        }
+
+        ~MutexGuard() {
+            mutex.unlock();
+        }
+
+        MutexGuard(const MutexGuard&) = delete;
+        MutexGuard& operator=(const MutexGuard&) = delete;
+    };
+} // namespace cosmos::sync
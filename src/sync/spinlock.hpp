@@ -0,0 +1,78 @@
+#pragma once
+
+#include "utils.hpp"
+
+#include <atomic>
+
+namespace cosmos::sync {
+    /// Ticket lock, waiting cpus get the lock in the order they arrived instead of whoever wins the cache line
+    struct SpinLock {
+        std::atomic<uint32_t> next_ticket = 0;
+        std::atomic<uint32_t> owner = 0;
+
+        /// Number of lock() calls which had to wait for another holder
+        std::atomic<uint32_t> contentions = 0;
+
+        void lock() {
+            const auto ticket = next_ticket.fetch_add(1, std::memory_order_relaxed);
+            if (owner.load(std::memory_order_acquire) == ticket) return;
+
+            contentions.fetch_add(1, std::memory_order_relaxed);
+
+            while (owner.load(std::memory_order_acquire) != ticket) {
+                asm volatile("pause" ::: "memory");
+            }
+        }
+
+        bool try_lock() {
+            auto ticket = owner.load(std::memory_order_relaxed);
+            return next_ticket.compare_exchange_strong(ticket, ticket + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        /// Does not need to be called by the context which took the lock, the scheduler hands it over across context switches
+        void unlock() {
+            owner.store(owner.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool is_locked() const {
+            return owner.load(std::memory_order_relaxed) != next_ticket.load(std::memory_order_relaxed);
+        }
+    };
+
+    /// Disables interrupts for its lifetime and puts RFLAGS.IF back to what it was, so nested sections do not enable them early
+    struct IrqSaveGuard {
+        bool enabled;
+
+        IrqSaveGuard() : enabled(utils::disable_interrupts()) {}
+
+        ~IrqSaveGuard() {
+            utils::restore_interrupts(enabled);
+        }
+
+        IrqSaveGuard(const IrqSaveGuard&) = delete;
+        IrqSaveGuard& operator=(const IrqSaveGuard&) = delete;
+    };
+
+    struct LockGuard {
+        SpinLock& lock;
+
+        explicit LockGuard(SpinLock& lock) : lock(lock) {
+            lock.lock();
+        }
+
+        ~LockGuard() {
+            lock.unlock();
+        }
+
+        LockGuard(const LockGuard&) = delete;
+        LockGuard& operator=(const LockGuard&) = delete;
+    };
+
+    /// For locks which are also taken in interrupt handlers, interrupts stay disabled until the lock is released
+    struct IrqLockGuard {
+        IrqSaveGuard irq;
+        LockGuard guard;
+
+        explicit IrqLockGuard(SpinLock& lock) : guard(lock) {}
+    };
+} // namespace cosmos::sync
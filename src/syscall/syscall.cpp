@@ -0,0 +1,379 @@
+#include "syscall.hpp"
+
+#include "gdt.hpp"
+#include "log/log.hpp"
+#include "memory/offsets.hpp"
+#include "memory/physical.hpp"
+#include "memory/virtual.hpp"
+#include "scheduler/futex.hpp"
+#include "scheduler/scheduler.hpp"
+#include "utils.hpp"
+#include "vfs/vfs.hpp"
+
+namespace cosmos::syscall {
+    constexpr uint32_t MSR_EFER = 0xC0000080;
+    constexpr uint32_t MSR_STAR = 0xC0000081;
+    constexpr uint32_t MSR_LSTAR = 0xC0000082;
+    constexpr uint32_t MSR_FMASK = 0xC0000084;
+    constexpr uint32_t MSR_KERNEL_GS_BASE = 0xC0000102;
+
+    constexpr uint64_t EFER_SCE = 1 << 0;
+
+    /// Trap, interrupt and direction flag, interrupts stay off until the entry switched to the kernel stack
+    constexpr uint64_t FMASK = (1 << 8) | (1 << 9) | (1 << 10);
+
+    constexpr uint64_t MAX_PATH = 256;
+
+    // Arguments
+
+    /// Ranges passed by user mode have to end below USER_END, the kernel half is mapped in every space
+    bool check_user(const uint64_t address, const uint64_t size) {
+        return address + size >= address && address + size <= memory::virt::USER_END;
+    }
+
+    // User copies
+
+    /// Returns the number of bytes which were not copied. A fault on the rep movsb resumes after it with rcx still holding that.
+    extern "C" __attribute__((naked)) uint64_t user_copy([[maybe_unused]] void* dst, [[maybe_unused]] const void* src,
+                                                         [[maybe_unused]] uint64_t size) {
+        asm volatile(R"(
+        .global user_copy_movs
+        .global user_copy_done
+
+        mov %rdx, %rcx
+
+        user_copy_movs:
+        rep movsb
+
+        user_copy_done:
+        mov %rcx, %rax
+        ret
+    )");
+    }
+
+    extern "C" const uint8_t user_copy_movs[];
+    extern "C" const uint8_t user_copy_done[];
+
+    bool copy_from_user(void* dst, const uint64_t src, const uint64_t size) {
+        if (!check_user(src, size)) return false;
+        return user_copy(dst, reinterpret_cast<const void*>(src), size) == 0;
+    }
+
+    bool copy_to_user(const uint64_t dst, const void* src, const uint64_t size) {
+        if (!check_user(dst, size)) return false;
+        return user_copy(reinterpret_cast<void*>(dst), src, size) == 0;
+    }
+
+    bool fixup_user_copy(isr::InterruptInfo* info) {
+        if (info->iret_rip != reinterpret_cast<uint64_t>(user_copy_movs)) return false;
+
+        info->iret_rip = reinterpret_cast<uint64_t>(user_copy_done);
+        return true;
+    }
+
+    vfs::File* get_file(const uint64_t handle) {
+        if (handle >= scheduler::MAX_FILES) return nullptr;
+        return scheduler::get_files()[handle];
+    }
+
+    // Calls
+
+    uint64_t sys_exit(const uint64_t status, uint64_t, uint64_t, uint64_t, uint64_t) {
+        scheduler::exit(status);
+        return 0;
+    }
+
+    uint64_t sys_yield(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+        scheduler::yield();
+        return 0;
+    }
+
+    uint64_t sys_sleep(const uint64_t ms, uint64_t, uint64_t, uint64_t, uint64_t) {
+        scheduler::sleep(ms);
+        return 0;
+    }
+
+    uint64_t sys_get_pid(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) {
+        return scheduler::get_process_pid(scheduler::get_current_process());
+    }
+
+    uint64_t sys_open(const uint64_t path, const uint64_t length, const uint64_t mode, uint64_t, uint64_t) {
+        if (length == 0 || length >= MAX_PATH || !check_user(path, length)) return FAILURE;
+        if (mode > static_cast<uint64_t>(vfs::Mode::ReadWrite)) return FAILURE;
+
+        const auto files = scheduler::get_files();
+        auto handle = 0u;
+
+        while (handle < scheduler::MAX_FILES && files[handle] != nullptr) {
+            handle++;
+        }
+
+        if (handle == scheduler::MAX_FILES) return FAILURE;
+
+        // Copied so user mode cannot change it while the lookup runs
+        char buffer[MAX_PATH];
+        if (!copy_from_user(buffer, path, length)) return FAILURE;
+        buffer[length] = '\0';
+
+        const auto file = vfs::open_file(stl::StringView(buffer, length), static_cast<vfs::Mode>(mode));
+        if (file == nullptr) return FAILURE;
+
+        files[handle] = file;
+        return handle;
+    }
+
+    uint64_t sys_close(const uint64_t handle, uint64_t, uint64_t, uint64_t, uint64_t) {
+        const auto file = get_file(handle);
+        if (file == nullptr) return FAILURE;
+
+        scheduler::get_files()[handle] = nullptr;
+        vfs::close_file(file);
+
+        return 0;
+    }
+
+    /// File operations only ever see kernel buffers, user memory is copied in chunks of this size
+    constexpr uint64_t CHUNK_SIZE = 1024;
+
+    uint64_t sys_read(const uint64_t handle, const uint64_t buffer, const uint64_t length, uint64_t, uint64_t) {
+        const auto file = get_file(handle);
+        if (file == nullptr || file->ops->read == nullptr || !vfs::is_read(file->mode)) return FAILURE;
+        if (!check_user(buffer, length)) return FAILURE;
+
+        uint8_t chunk[CHUNK_SIZE];
+        uint64_t total = 0;
+
+        while (total < length) {
+            const auto size = utils::min(length - total, CHUNK_SIZE);
+
+            const auto read = file->ops->read(file, chunk, size);
+            if (read == 0) break;
+
+            if (!copy_to_user(buffer + total, chunk, read)) return FAILURE;
+            total += read;
+
+            if (read < size) break;
+        }
+
+        return total;
+    }
+
+    uint64_t sys_write(const uint64_t handle, const uint64_t buffer, const uint64_t length, uint64_t, uint64_t) {
+        const auto file = get_file(handle);
+        if (file == nullptr || file->ops->write == nullptr || !vfs::is_write(file->mode)) return FAILURE;
+        if (!check_user(buffer, length)) return FAILURE;
+
+        uint8_t chunk[CHUNK_SIZE];
+        uint64_t total = 0;
+
+        while (total < length) {
+            const auto size = utils::min(length - total, CHUNK_SIZE);
+            if (!copy_from_user(chunk, buffer + total, size)) return FAILURE;
+
+            const auto written = file->ops->write(file, chunk, size);
+            total += written;
+
+            if (written < size) break;
+        }
+
+        return total;
+    }
+
+    uint64_t sys_seek(const uint64_t handle, const uint64_t type, const uint64_t offset, uint64_t, uint64_t) {
+        const auto file = get_file(handle);
+        if (file == nullptr || file->ops->seek == nullptr) return FAILURE;
+        if (type > static_cast<uint64_t>(vfs::SeekType::End)) return FAILURE;
+
+        return file->ops->seek(file, static_cast<vfs::SeekType>(type), static_cast<int64_t>(offset));
+    }
+
+    uint64_t sys_ioctl(const uint64_t handle, const uint64_t op, const uint64_t arg, uint64_t, uint64_t) {
+        const auto file = get_file(handle);
+        if (file == nullptr || file->ops->ioctl == nullptr) return FAILURE;
+
+        return file->ops->ioctl(file, op, arg);
+    }
+
+    /// Futex words are 32 bits and naturally aligned
+    const std::atomic<uint32_t>* get_word(const uint64_t address) {
+        if (address % 4 != 0 || !check_user(address, 4)) return nullptr;
+        return reinterpret_cast<const std::atomic<uint32_t>*>(address);
+    }
+
+    /// Returns the scheduler::WaitResult
+    uint64_t sys_futex_wait(const uint64_t address, const uint64_t expected, const uint64_t timeout_ms, uint64_t, uint64_t) {
+        const auto word = get_word(address);
+        if (word == nullptr) return FAILURE;
+
+        // Maps the page if it can be, the wait itself reads the word directly
+        uint32_t value;
+        if (!copy_from_user(&value, address, sizeof(uint32_t))) return FAILURE;
+
+        return static_cast<uint64_t>(scheduler::wait_on_address(word, static_cast<uint32_t>(expected), timeout_ms));
+    }
+
+    uint64_t sys_futex_wake(const uint64_t address, const uint64_t count, uint64_t, uint64_t, uint64_t) {
+        const auto word = get_word(address);
+        if (word == nullptr) return FAILURE;
+
+        return scheduler::wake_address(word, count > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(count));
+    }
+
+    using SyscallFn = uint64_t (*)(uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4);
+
+    /// Indexed by Number
+    static constexpr SyscallFn table[] = {
+        sys_exit, sys_yield, sys_sleep, sys_get_pid, sys_open, sys_close, sys_read, sys_write, sys_seek, sys_ioctl,
+        sys_futex_wait, sys_futex_wake,
+    };
+
+    static_assert(sizeof(table) / sizeof(SyscallFn) == static_cast<uint64_t>(Number::FutexWake) + 1);
+
+    extern "C" uint64_t syscall_dispatch(const uint64_t arg0, const uint64_t arg1, const uint64_t arg2, const uint64_t arg3,
+                                         const uint64_t arg4, const uint64_t number) {
+        if (number >= sizeof(table) / sizeof(SyscallFn)) return FAILURE;
+        return table[number](arg0, arg1, arg2, arg3, arg4);
+    }
+
+    // Entry
+
+    /// Target of SYSCALL. The cpu only saved the return address in rcx and the flags in r11, it is still on the user stack.
+    /// The stack of the current process is empty while it runs in user mode, see scheduler::load_kernel_stack().
+    extern "C" __attribute__((naked)) void syscall_entry() {
+        asm volatile(R"(
+        swapgs
+        mov %rsp, %gs:16
+        mov %gs:8, %rsp
+
+        # User stack, flags and return address, plus a slot keeping the stack aligned for the call
+        pushq %gs:16
+        push %r11
+        push %rcx
+        sub $8, %rsp
+
+        # The fourth argument goes in rcx for C, the number becomes the sixth one
+        mov %r10, %rcx
+        mov %rax, %r9
+
+        # Other cpus can pick up the process while it is preempted, gs is only used again with interrupts disabled
+        sti
+        call syscall_dispatch
+        cli
+
+        # Nothing of the kernel should be left in the registers the call did not preserve
+        xor %edi, %edi
+        xor %esi, %esi
+        xor %edx, %edx
+        xor %r8d, %r8d
+        xor %r9d, %r9d
+        xor %r10d, %r10d
+
+        add $8, %rsp
+        pop %rcx
+        pop %r11
+        pop %rsp
+
+        swapgs
+        sysretq
+    )");
+    }
+
+    // Init
+
+    void init_cpu() {
+        utils::write_msr(MSR_EFER, utils::read_msr(MSR_EFER) | EFER_SCE);
+
+        // SYSRET loads the user code segment from 16 above the base and the user stack segment from 8 above it
+        const auto sysret_base = static_cast<uint64_t>((gdt::USER_DATA & ~3) - 8);
+        utils::write_msr(MSR_STAR, (sysret_base << 48) | (static_cast<uint64_t>(gdt::KERNEL_CODE) << 32));
+
+        utils::write_msr(MSR_LSTAR, reinterpret_cast<uint64_t>(syscall_entry));
+        utils::write_msr(MSR_FMASK, FMASK);
+
+        // Swapped in as the GS base of user mode
+        utils::write_msr(MSR_KERNEL_GS_BASE, 0);
+    }
+
+    void init() {
+        init_cpu();
+        INFO("[syscall] Enabled SYSCALL with %d calls", sizeof(table) / sizeof(SyscallFn));
+    }
+
+    // Benchmark
+
+    /// Position independent, it gets copied into a user page. Reads the iteration count from the top of its stack and exits with
+    /// the total number of cycles.
+    extern "C" __attribute__((naked)) void benchmark_program() {
+        asm volatile(R"(
+        .global benchmark_start
+        .global benchmark_end
+
+        benchmark_start:
+        mov (%rsp), %r13
+
+        rdtsc
+        shl $32, %rdx
+        or %rdx, %rax
+        mov %rax, %r12
+
+    1:
+        mov $3, %eax
+        syscall
+        dec %r13
+        jnz 1b
+
+        rdtsc
+        shl $32, %rdx
+        or %rdx, %rax
+        sub %r12, %rax
+
+        mov %rax, %rdi
+        mov $0, %eax
+        syscall
+        ud2
+
+        benchmark_end:
+    )");
+    }
+
+    extern "C" const uint8_t benchmark_start[];
+    extern "C" const uint8_t benchmark_end[];
+
+    static_assert(static_cast<uint64_t>(Number::Exit) == 0 && static_cast<uint64_t>(Number::GetPid) == 3);
+
+    constexpr uint64_t BENCHMARK_CODE = 0x400000;
+    constexpr uint64_t BENCHMARK_STACK = 0x800000;
+
+    uint64_t benchmark(const uint64_t iterations) {
+        if (iterations == 0) return 0;
+
+        const auto space = memory::virt::create();
+        if (space == 0) return 0;
+
+        const auto code = memory::phys::alloc_pages(1);
+        const auto stack = memory::phys::alloc_pages(1);
+
+        // Once mapped the pages belong to the space and get freed with it
+        using memory::virt::map_user_pages;
+
+        const auto code_mapped = code != 0 && map_user_pages(space, BENCHMARK_CODE / 4096ul, code / 4096ul, 1, false, false);
+        const auto stack_mapped = stack != 0 && map_user_pages(space, BENCHMARK_STACK / 4096ul, stack / 4096ul, 1, true, false);
+
+        if (!code_mapped || !stack_mapped) {
+            if (code != 0 && !code_mapped) memory::phys::free_pages(code / 4096ul, 1);
+            if (stack != 0 && !stack_mapped) memory::phys::free_pages(stack / 4096ul, 1);
+
+            memory::virt::destroy(space);
+            return 0;
+        }
+
+        utils::memcpy(reinterpret_cast<void*>(memory::virt::DIRECT_MAP + code), benchmark_start, benchmark_end - benchmark_start);
+        *reinterpret_cast<uint64_t*>(memory::virt::DIRECT_MAP + stack + 4096 - 8) = iterations;
+
+        const auto process = scheduler::create_user_process(space, nullptr, BENCHMARK_CODE, BENCHMARK_STACK + 4096 - 8);
+        const auto cycles = scheduler::join(process);
+
+        if (cycles == FAILURE) return 0;
+        return cycles / iterations;
+    }
+} // namespace cosmos::syscall
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::isr {
+    struct InterruptInfo;
+} // namespace cosmos::isr
+
+namespace cosmos::syscall {
+    /// Passed in rax, the arguments go in rdi, rsi, rdx, r10 and r8 and the result comes back in rax.
+    /// The instruction itself clobbers rcx and r11, the other registers are preserved.
+    enum class Number : uint64_t {
+        Exit,
+        Yield,
+        Sleep,
+        GetPid,
+        Open,
+        Close,
+        Read,
+        Write,
+        Seek,
+        Ioctl,
+        FutexWait,
+        FutexWake,
+    };
+
+    /// Result of calls which failed
+    constexpr uint64_t FAILURE = static_cast<uint64_t>(-1);
+
+    /// Enables the SYSCALL instruction on the bootstrap processor
+    void init();
+
+    /// Applies the same configuration on an application processor
+    void init_cpu();
+
+    /// Copy between kernel memory and a user range, failing instead of faulting if part of the range is not accessible.
+    /// Pages of the program which were not touched yet get loaded on the way, so they need process context.
+    bool copy_from_user(void* dst, uint64_t src, uint64_t size);
+    bool copy_to_user(uint64_t dst, const void* src, uint64_t size);
+
+    /// Called by the page fault handler for kernel mode faults it could not resolve. Returns true if the fault happened in a
+    /// user copy, which then fails once the handler returns.
+    bool fixup_user_copy(isr::InterruptInfo* info);
+
+    /// Runs a user process making the given number of system calls which do no work, to measure the cost of the round trip.
+    /// Returns the average TSC cycles per call or 0 if it failed.
+    uint64_t benchmark(uint64_t iterations);
+} // namespace cosmos::syscall
@@ -0,0 +1,153 @@
+#include "clockevent.hpp"
+
+#include "clocksource.hpp"
+#include "devices/pit.hpp"
+#include "interrupts/isr.hpp"
+#include "interrupts/lapic.hpp"
+#include "log/log.hpp"
+#include "scheduler/scheduler.hpp"
+#include "smp/smp.hpp"
+#include "timer.hpp"
+#include "utils.hpp"
+
+namespace cosmos::time::clockevent {
+    constexpr uint32_t CALIBRATION_MS = 10;
+    constexpr uint64_t NS_PER_MS = 1'000'000;
+
+    constexpr uint64_t DISARMED = UINT64_MAX;
+
+    static Mode mode = Mode::Pit;
+
+    static uint64_t tsc_per_ms = 0;
+    static uint64_t lapic_per_ms = 0;
+
+    /// Deadline the timer of each cpu is currently armed for
+    static uint64_t armed[smp::MAX_CPUS];
+
+    /// Counts local APIC timer ticks while the TSC advances by a known amount
+    void calibrate() {
+        const auto enabled = utils::disable_interrupts();
+
+        lapic::setup_timer(isr::TIMER, false);
+
+        const auto end = utils::read_tsc() + ms_to_tsc(CALIBRATION_MS);
+        lapic::start_timer(UINT32_MAX);
+
+        while (utils::read_tsc() < end) {
+            utils::pause();
+        }
+
+        const auto lapic_elapsed = UINT32_MAX - lapic::get_timer_count();
+
+        lapic::start_timer(0);
+        utils::restore_interrupts(enabled);
+
+        lapic_per_ms = lapic_elapsed / CALIBRATION_MS;
+    }
+
+    void on_timer([[maybe_unused]] isr::InterruptInfo* info) {
+        handle();
+    }
+
+    void init() {
+        for (auto i = 0u; i < smp::MAX_CPUS; i++) {
+            armed[i] = DISARMED;
+        }
+
+        tsc_per_ms = get_tsc_frequency() / 1000;
+        calibrate();
+
+        // TSC deadlines are only meaningful if the TSC matches the clocksource
+        const auto tsc_deadline = lapic::has_tsc_deadline() && get_source() == Source::Tsc;
+
+        if (!tsc_deadline && lapic_per_ms == 0) {
+            mode = Mode::Pit;
+            devices::pit::start();
+
+            WARN("[clockevent] Local APIC timer calibration failed, using periodic PIT interrupts");
+            return;
+        }
+
+        mode = tsc_deadline ? Mode::TscDeadline : Mode::Lapic;
+
+        isr::set_ipi(isr::TIMER, on_timer);
+        init_cpu();
+
+        INFO("[clockevent] Using %s", tsc_deadline ? "TSC-deadline" : "one-shot local APIC timer");
+    }
+
+    void init_cpu() {
+        if (mode == Mode::Pit) return;
+
+        const auto enabled = utils::disable_interrupts();
+
+        armed[smp::get_id()] = DISARMED;
+        lapic::setup_timer(isr::TIMER, mode == Mode::TscDeadline);
+
+        utils::restore_interrupts(enabled);
+    }
+
+    Mode get_mode() {
+        return mode;
+    }
+
+    uint64_t get_ms() {
+        return now_ns() / NS_PER_MS;
+    }
+
+    uint64_t ms_to_tsc(const uint64_t ms) {
+        return ms * tsc_per_ms;
+    }
+
+    void arm(const uint64_t deadline) {
+        if (mode == Mode::Pit) return;
+
+        const auto id = smp::get_id();
+        if (deadline >= armed[id]) return;
+
+        armed[id] = deadline;
+
+        if (mode == Mode::TscDeadline) {
+            lapic::set_timer_deadline(deadline);
+            return;
+        }
+
+        const auto now = utils::read_tsc();
+        auto delta = deadline > now ? deadline - now : 1;
+
+        // Deadlines too far away for the 32-bit counter fire early and get armed again
+        const auto max_delta = tsc_per_ms * (UINT32_MAX / lapic_per_ms);
+        if (delta > max_delta) delta = max_delta;
+
+        const auto count = delta * lapic_per_ms / tsc_per_ms;
+        lapic::start_timer(count > 0 ? static_cast<uint32_t>(count) : 1);
+    }
+
+    void arm_ms(const uint64_t ms) {
+        if (mode == Mode::Pit) return;
+        arm(ns_to_tsc(ms * NS_PER_MS));
+    }
+
+    void handle() {
+        if (mode == Mode::Pit) {
+            // Application processors have no timer of their own in this mode, make them check their time slice
+            if (get_ms() % scheduler::get_quantum() == 0) {
+                const auto self = smp::get_id();
+
+                for (auto i = 0u; i < smp::get_count(); i++) {
+                    const auto cpu = smp::get_cpu(i);
+                    if (i != self && cpu->online) lapic::send_ipi(cpu->lapic_id, isr::IPI_RESCHEDULE);
+                }
+            }
+        } else {
+            armed[smp::get_id()] = DISARMED;
+        }
+
+        advance(get_ms());
+        update_page(get_ticks());
+        scheduler::tick();
+
+        const auto next = get_next_expiry();
+        if (next != NO_EXPIRY) arm_ms(next);
+    }
+} // namespace cosmos::time::clockevent
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::time::clockevent {
+    enum class Mode : uint8_t {
+        /// Periodic 1 ms interrupts on the bootstrap processor
+        Pit,
+        /// One-shot local APIC timer calibrated against the TSC
+        Lapic,
+        /// Local APIC timer firing at an absolute TSC value
+        TscDeadline,
+    };
+
+    /// Calibrates the local APIC timer against the TSC and sets up the timer of the bootstrap processor, needs time::init().
+    /// Falls back to periodic PIT interrupts if the local APIC timer cannot be used.
+    void init();
+
+    /// Sets up the timer of an application processor, needs to be called after init()
+    void init_cpu();
+
+    Mode get_mode();
+
+    /// Milliseconds on the clocksource, the timer wheel runs on this clock
+    uint64_t get_ms();
+
+    uint64_t ms_to_tsc(uint64_t ms);
+
+    /// Makes sure the calling cpu gets a timer interrupt no later than the given TSC value, needs interrupts disabled
+    void arm(uint64_t deadline);
+
+    /// Same as arm() for a point in time on the get_ms() clock
+    void arm_ms(uint64_t ms);
+
+    /// Runs expired timers and the scheduler tick, called from the timer interrupt
+    void handle();
+} // namespace cosmos::time::clockevent
@@ -0,0 +1,237 @@
+#include "clocksource.hpp"
+
+#include "acpi/acpi.hpp"
+#include "devices/pit.hpp"
+#include "log/log.hpp"
+#include "memory/offsets.hpp"
+#include "memory/physical.hpp"
+#include "memory/virtual.hpp"
+#include "sync/spinlock.hpp"
+#include "utils.hpp"
+
+namespace cosmos::time {
+    constexpr uint64_t NS_PER_SECOND = 1'000'000'000;
+    constexpr uint64_t FS_PER_NS = 1'000'000;
+
+    constexpr uint32_t CALIBRATION_MS = 20;
+    constexpr uint64_t CALIBRATION_TIMEOUT = 100'000'000;
+
+    // HPET
+
+    constexpr uint32_t HPET_CAPABILITIES = 0x000 / 8;
+    constexpr uint32_t HPET_CONFIG = 0x010 / 8;
+    constexpr uint32_t HPET_COUNTER = 0x0F0 / 8;
+
+    constexpr uint64_t HPET_COUNTER_64BIT = 1ul << 13;
+    constexpr uint64_t HPET_ENABLE = 1ul << 0;
+
+    /// The specification caps the period at 100 ns
+    constexpr uint64_t HPET_MAX_PERIOD_FS = 100'000'000;
+
+    static volatile uint64_t* hpet = nullptr;
+    static uint64_t hpet_period_fs = 0;
+    static bool hpet_64bit = false;
+
+    bool init_hpet() {
+        const auto table = reinterpret_cast<const acpi::Hpet*>(acpi::find_table("HPET"));
+        if (table == nullptr || table->address.space_id != 0) return false;
+
+        hpet = reinterpret_cast<volatile uint64_t*>(memory::virt::map_mmio(table->address.address, 1024));
+        if (hpet == nullptr) return false;
+
+        const auto capabilities = hpet[HPET_CAPABILITIES];
+        hpet_period_fs = capabilities >> 32;
+        hpet_64bit = (capabilities & HPET_COUNTER_64BIT) != 0;
+
+        if (hpet_period_fs == 0 || hpet_period_fs > HPET_MAX_PERIOD_FS) {
+            hpet = nullptr;
+            return false;
+        }
+
+        hpet[HPET_CONFIG] = hpet[HPET_CONFIG] | HPET_ENABLE;
+        return true;
+    }
+
+    uint64_t hpet_elapsed(const uint64_t start) {
+        const auto elapsed = hpet[HPET_COUNTER] - start;
+        return hpet_64bit ? elapsed : elapsed & 0xFFFFFFFF;
+    }
+
+    uint64_t hpet_ns() {
+        const auto counter = hpet[HPET_COUNTER];
+        return (counter / FS_PER_NS) * hpet_period_fs + (counter % FS_PER_NS) * hpet_period_fs / FS_PER_NS;
+    }
+
+    // TSC
+
+    /// value * mult >> shift, see scale_cycles()
+    struct Scale {
+        uint64_t mult;
+        uint32_t shift;
+    };
+
+    static Source source = Source::Tsc;
+
+    static uint64_t tsc_frequency = 0;
+    static bool tsc_invariant = false;
+
+    static Scale tsc_to_ns = {};
+    static uint64_t base_tsc = 0;
+    static uint64_t base_hpet_ns = 0;
+
+    Scale make_scale(const uint64_t frequency) {
+        auto shift = 32u;
+
+        while (shift > 0 && (NS_PER_SECOND << shift) / frequency >= 1ull << 32) {
+            shift--;
+        }
+
+        return { .mult = (NS_PER_SECOND << shift) / frequency, .shift = shift };
+    }
+
+    uint64_t apply(const Scale& scale, const uint64_t value) {
+        return scale_cycles(value, scale.mult, scale.shift);
+    }
+
+    bool check_tsc_invariant() {
+        uint32_t eax, ebx, ecx, edx;
+
+        utils::cpuid(0x80000000, &eax, &ebx, &ecx, &edx);
+        if (eax < 0x80000007) return false;
+
+        utils::cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+        return (edx & (1u << 8)) != 0;
+    }
+
+    uint64_t calibrate_with_hpet() {
+        const auto counts = CALIBRATION_MS * 1'000'000ul * FS_PER_NS / hpet_period_fs;
+
+        const auto start_counter = hpet[HPET_COUNTER];
+        const auto start_tsc = utils::read_tsc();
+
+        while (hpet_elapsed(start_counter) < counts) {
+            utils::pause();
+        }
+
+        const auto elapsed_tsc = utils::read_tsc() - start_tsc;
+        const auto elapsed_ns = hpet_elapsed(start_counter) * hpet_period_fs / FS_PER_NS;
+
+        return elapsed_tsc * (NS_PER_SECOND / 1000) / (elapsed_ns / 1000);
+    }
+
+    uint64_t calibrate_with_pit() {
+        devices::pit::start_countdown(CALIBRATION_MS);
+        const auto start_tsc = utils::read_tsc();
+
+        for (auto i = 0ul; i < CALIBRATION_TIMEOUT; i++) {
+            if (devices::pit::is_countdown_done()) {
+                return (utils::read_tsc() - start_tsc) * 1000 / CALIBRATION_MS;
+            }
+        }
+
+        return 0;
+    }
+
+    // Time page
+
+    static TimePage* page = nullptr;
+
+    /// Only one cpu needs to update the page per tick, the others skip it while it is busy
+    static sync::SpinLock page_lock;
+
+    void init_page() {
+        const auto phys = memory::phys::alloc_pages(1);
+        if (phys == 0) utils::panic(nullptr, "[time] Failed to allocate the time page");
+
+        // Written through the direct map, user mode only gets a read-only mapping
+        const auto data = reinterpret_cast<TimePage*>(memory::virt::DIRECT_MAP + phys);
+        utils::memset(data, 0, 4096);
+
+        data->tsc_usable = source == Source::Tsc;
+        data->base_tsc = base_tsc;
+        data->base_ns = 0;
+        data->mult = tsc_to_ns.mult;
+        data->shift = tsc_to_ns.shift;
+        data->tsc_frequency = tsc_frequency;
+
+        if (!memory::virt::map_shared_user_page(memory::virt::TIME_PAGE / 4096ul, phys / 4096ul)) {
+            utils::panic(nullptr, "[time] Failed to map the time page");
+        }
+
+        page = data;
+    }
+
+    const TimePage* get_page() {
+        return page;
+    }
+
+    void update_page(const uint64_t ticks) {
+        if (page == nullptr || !page_lock.try_lock()) return;
+
+        const auto sequence = page->sequence.load(std::memory_order_relaxed);
+
+        page->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        page->ticks = ticks;
+        page->coarse_ns = now_ns();
+
+        page->sequence.store(sequence + 2, std::memory_order_release);
+        page_lock.unlock();
+    }
+
+    // Init
+
+    void init() {
+        const auto has_hpet = init_hpet();
+        tsc_invariant = check_tsc_invariant();
+
+        const auto enabled = utils::disable_interrupts();
+        tsc_frequency = has_hpet ? calibrate_with_hpet() : calibrate_with_pit();
+        utils::restore_interrupts(enabled);
+
+        if (tsc_frequency == 0) utils::panic(nullptr, "[time] Failed to calibrate the TSC");
+
+        tsc_to_ns = make_scale(tsc_frequency);
+        source = !tsc_invariant && has_hpet && hpet_64bit ? Source::Hpet : Source::Tsc;
+
+        base_tsc = utils::read_tsc();
+        if (source == Source::Hpet) base_hpet_ns = hpet_ns();
+
+        if (!tsc_invariant && source == Source::Tsc) WARN("[time] TSC is not invariant and there is no usable HPET");
+
+        init_page();
+
+        INFO("[time] TSC at %d kHz calibrated against the %s, clocksource is the %s", tsc_frequency / 1000, has_hpet ? "HPET" : "PIT",
+             source == Source::Tsc ? "TSC" : "HPET");
+    }
+
+    Source get_source() {
+        return source;
+    }
+
+    bool is_tsc_invariant() {
+        return tsc_invariant;
+    }
+
+    uint64_t get_tsc_frequency() {
+        return tsc_frequency;
+    }
+
+    uint64_t now_ns() {
+        if (source == Source::Hpet) return hpet_ns() - base_hpet_ns;
+        return apply(tsc_to_ns, utils::read_tsc() - base_tsc);
+    }
+
+    uint64_t cycles_to_ns(const uint64_t cycles) {
+        return apply(tsc_to_ns, cycles);
+    }
+
+    uint64_t ns_to_cycles(const uint64_t ns) {
+        return (ns / NS_PER_SECOND) * tsc_frequency + (ns % NS_PER_SECOND) * tsc_frequency / NS_PER_SECOND;
+    }
+
+    uint64_t ns_to_tsc(const uint64_t ns) {
+        return base_tsc + ns_to_cycles(ns);
+    }
+} // namespace cosmos::time
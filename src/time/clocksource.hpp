@@ -0,0 +1,38 @@
+#pragma once
+
+#include "page.hpp"
+
+#include <cstdint>
+
+namespace cosmos::time {
+    enum class Source : uint8_t {
+        Tsc,
+        /// Used when the TSC does not tick at a constant rate and an HPET with a 64-bit counter exists
+        Hpet,
+    };
+
+    /// Calibrates the TSC against the HPET, or the PIT if there is none, and picks the clocksource. Needs acpi::init().
+    void init();
+
+    Source get_source();
+
+    bool is_tsc_invariant();
+
+    /// Calibrated TSC frequency in Hz
+    uint64_t get_tsc_frequency();
+
+    /// Monotonic nanoseconds since init()
+    uint64_t now_ns();
+
+    uint64_t cycles_to_ns(uint64_t cycles);
+    uint64_t ns_to_cycles(uint64_t ns);
+
+    /// TSC value at which now_ns() reaches the given time, only accurate while the TSC is invariant
+    uint64_t ns_to_tsc(uint64_t ns);
+
+    /// Kernel view of the time page, nullptr before init()
+    const TimePage* get_page();
+
+    /// Refreshes the coarse time on the time page, called by timer interrupts
+    void update_page(uint64_t ticks);
+} // namespace cosmos::time
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace cosmos::time {
+    /// Mapped read-only at memory::virt::TIME_PAGE in every space. Only depends on the compiler headers, so user programs can
+    /// include it as well.
+    struct TimePage {
+        /// Odd while the kernel updates the page, readers retry if it was odd or changed while they copied the fields
+        std::atomic<uint32_t> sequence;
+
+        /// 0 if the TSC does not follow the clocksource, only the coarse time can be used then
+        uint32_t tsc_usable;
+
+        /// Nanoseconds are base_ns plus the TSC cycles since base_tsc scaled by mult and shift
+        uint64_t base_tsc;
+        uint64_t base_ns;
+        uint64_t mult;
+        uint32_t shift;
+
+        uint64_t tsc_frequency;
+
+        /// Timer wheel milliseconds and clocksource nanoseconds at the last update by a timer interrupt
+        uint64_t ticks;
+        uint64_t coarse_ns;
+    };
+
+    /// cycles * mult >> shift, mult stays below 2^32 so multiplying the low half of the cycles never overflows
+    inline uint64_t scale_cycles(const uint64_t cycles, const uint64_t mult, const uint32_t shift) {
+        const auto high = cycles >> 32;
+        const auto low = cycles & 0xFFFFFFFF;
+
+        return ((high * mult) << (32 - shift)) + ((low * mult) >> shift);
+    }
+
+    /// Monotonic nanoseconds since boot without entering the kernel or taking a lock
+    inline uint64_t read_ns(const TimePage* page) {
+        for (;;) {
+            const auto sequence = page->sequence.load(std::memory_order_acquire);
+
+            if ((sequence & 1) != 0) {
+                asm volatile("pause");
+                continue;
+            }
+
+            const auto tsc_usable = page->tsc_usable;
+            const auto base_tsc = page->base_tsc;
+            const auto base_ns = page->base_ns;
+            const auto mult = page->mult;
+            const auto shift = page->shift;
+            const auto coarse_ns = page->coarse_ns;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (page->sequence.load(std::memory_order_relaxed) != sequence) continue;
+
+            if (tsc_usable == 0) return coarse_ns;
+
+            uint32_t low, high;
+            asm volatile("rdtsc" : "=a"(low), "=d"(high));
+
+            return base_ns + scale_cycles(((static_cast<uint64_t>(high) << 32) | low) - base_tsc, mult, shift);
+        }
+    }
+} // namespace cosmos::time
@@ -0,0 +1,194 @@
+#include "timer.hpp"
+
+#include "clockevent.hpp"
+#include "stl/intrusive_list.hpp"
+#include "sync/spinlock.hpp"
+#include "utils.hpp"
+
+namespace cosmos::time {
+    // Four levels of 64 slots, level n covers expiries up to 64^(n+1) ticks away with a granularity of 64^n ticks.
+    // Timers further away than the last level go into its farthest slot and get placed again when it cascades.
+
+    constexpr uint32_t LEVELS = 4;
+    constexpr uint32_t SLOT_BITS = 6;
+    constexpr uint32_t SLOTS = 1u << SLOT_BITS;
+    constexpr uint64_t SLOT_MASK = SLOTS - 1;
+
+    constexpr uint64_t MAX_DELTA = (1ull << (LEVELS * SLOT_BITS)) - 1;
+
+    /// Protects the wheel, timer callbacks run with it held
+    static sync::SpinLock lock;
+
+    static stl::IntrusiveList<Timer> wheel[LEVELS][SLOTS];
+    static std::atomic<uint64_t> ticks = 0;
+
+    void add(Timer* timer) {
+        const auto now = ticks.load();
+        auto expires = timer->expires;
+
+        // Timers cascading down on the tick they are due at land in the slot that is processed right after
+        if (expires < now) expires = now;
+        if (expires - now > MAX_DELTA) expires = now + MAX_DELTA;
+
+        const auto delta = expires - now;
+        auto level = 0u;
+
+        while (level < LEVELS - 1 && delta >= 1ull << ((level + 1) * SLOT_BITS)) {
+            level++;
+        }
+
+        timer->level = static_cast<uint8_t>(level);
+        timer->slot = static_cast<uint8_t>((expires >> (level * SLOT_BITS)) & SLOT_MASK);
+
+        wheel[timer->level][timer->slot].push_back(timer);
+    }
+
+    /// Moves the timers of one slot on a higher level down to the levels below it
+    void cascade(const uint32_t level, const uint64_t slot) {
+        auto& list = wheel[level][slot];
+
+        while (const auto timer = list.pop_front()) {
+            add(timer);
+        }
+    }
+
+    /// Earliest tick at which something happens on the wheel, either a timer expiring or a non-empty slot cascading
+    uint64_t next_event() {
+        const auto now = ticks.load();
+        auto next = NO_EXPIRY;
+
+        for (auto level = 0u; level < LEVELS; level++) {
+            const auto shift = level * SLOT_BITS;
+
+            for (auto i = 1u; i <= SLOTS; i++) {
+                const auto position = (now >> shift) + i;
+                if (wheel[level][position & SLOT_MASK].empty()) continue;
+
+                const auto tick = position << shift;
+                if (tick < next) next = tick;
+
+                break;
+            }
+        }
+
+        return next;
+    }
+
+    void process_tick() {
+        const auto now = ++ticks;
+
+        // Pull down the higher levels whenever the level below them wrapped around
+        for (auto level = 1u; level < LEVELS; level++) {
+            if ((now & ((1ull << (level * SLOT_BITS)) - 1)) != 0) break;
+            cascade(level, (now >> (level * SLOT_BITS)) & SLOT_MASK);
+        }
+
+        auto& list = wheel[0][now & SLOT_MASK];
+
+        while (const auto timer = list.pop_front()) {
+            if (timer->period != 0) {
+                timer->expires = now + timer->period;
+                add(timer);
+            } else {
+                timer->pending = false;
+            }
+
+            timer->fn(timer->data);
+        }
+    }
+
+    void catch_up(const uint64_t now) {
+        while (ticks < now) {
+            // Ticks without anything to run or cascade are skipped instead of being walked one by one
+            const auto next = next_event();
+            ticks = (next < now ? next : now) - 1;
+
+            process_tick();
+        }
+    }
+
+    void init_timer(Timer* timer, const TimerFn fn, const uint64_t data) {
+        timer->next = nullptr;
+        timer->prev = nullptr;
+
+        timer->fn = fn;
+        timer->data = data;
+
+        timer->expires = 0;
+        timer->period = 0;
+
+        timer->level = 0;
+        timer->slot = 0;
+        timer->pending = false;
+    }
+
+    void remove(Timer* timer) {
+        wheel[timer->level][timer->slot].remove(timer);
+    }
+
+    void start_timer(Timer* timer, const uint64_t ms, const uint64_t period_ms) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        if (timer->pending) remove(timer);
+
+        // Without periodic ticks the wheel only moves when a timer fires, bring it up to date first
+        catch_up(clockevent::get_ms());
+
+        timer->expires = ticks + (ms > 0 ? ms : 1);
+        timer->period = period_ms;
+        timer->pending = true;
+
+        add(timer);
+        const auto expires = timer->expires;
+
+        lock.unlock();
+
+        // The calling cpu gets the interrupt, whichever cpu advances the wheel first runs the timer
+        clockevent::arm_ms(expires);
+        utils::restore_interrupts(enabled);
+    }
+
+    bool cancel_timer(Timer* timer) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto pending = timer->pending;
+
+        if (pending) {
+            remove(timer);
+            timer->pending = false;
+        }
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return pending;
+    }
+
+    void advance(const uint64_t now) {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        catch_up(now);
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+    }
+
+    uint64_t get_next_expiry() {
+        const auto enabled = utils::disable_interrupts();
+        lock.lock();
+
+        const auto next = next_event();
+
+        lock.unlock();
+        utils::restore_interrupts(enabled);
+
+        return next;
+    }
+
+    uint64_t get_ticks() {
+        return ticks;
+    }
+} // namespace cosmos::time
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cosmos::time {
+    using TimerFn = void (*)(uint64_t data);
+
+    /// Owned by the caller, the wheel only links it into its slots while the timer is pending
+    struct Timer {
+        Timer* next;
+        Timer* prev;
+
+        TimerFn fn;
+        uint64_t data;
+
+        /// Tick at which the timer fires next, period is 0 for one-shot timers
+        uint64_t expires;
+        uint64_t period;
+
+        /// Slot of the wheel the timer is linked into, so cancelling does not need to search for it
+        uint8_t level;
+        uint8_t slot;
+
+        bool pending;
+    };
+
+    void init_timer(Timer* timer, TimerFn fn, uint64_t data);
+
+    /// Arms the timer to fire in ms milliseconds and then every period_ms milliseconds if that is not 0.
+    /// A pending timer is re-armed. The callback runs in interrupt context and must not use timer functions itself.
+    void start_timer(Timer* timer, uint64_t ms, uint64_t period_ms);
+
+    /// Returns whether the timer was still pending, once this returns its callback is not running anymore
+    bool cancel_timer(Timer* timer);
+
+    constexpr uint64_t NO_EXPIRY = UINT64_MAX;
+
+    /// Moves the wheel forward to the given millisecond and runs the timers which expired on the way
+    void advance(uint64_t now);
+
+    /// Millisecond by which advance() needs to be called next, NO_EXPIRY if no timer is pending
+    uint64_t get_next_expiry();
+
+    uint64_t get_ticks();
+} // namespace cosmos::time
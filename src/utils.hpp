@@ -87,9 +87,52 @@ namespace cosmos::utils {
         asm volatile("out %%eax, %%dx" ::"a"(data), "d"(port));
     }
 
+    // MSR
+
+    inline uint64_t read_msr(const uint32_t msr) {
+        uint32_t low, high;
+        asm volatile("rdmsr" : "=a"(low), "=d"(high) : "c"(msr));
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
+
+    inline void write_msr(const uint32_t msr, const uint64_t value) {
+        asm volatile("wrmsr" ::"c"(msr), "a"(static_cast<uint32_t>(value)), "d"(static_cast<uint32_t>(value >> 32)));
+    }
+
+    // TSC
+
+    inline uint64_t read_tsc() {
+        uint32_t low, high;
+        asm volatile("rdtsc" : "=a"(low), "=d"(high));
+        return (static_cast<uint64_t>(high) << 32) | low;
+    }
+
+    // Interrupts
+
+    inline bool interrupts_enabled() {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0" : "=r"(flags)::"memory");
+        return (flags & 0x200) != 0;
+    }
+
+    /// Disables interrupts and returns whether they were enabled before
+    inline bool disable_interrupts() {
+        uint64_t flags;
+        asm volatile("pushfq; pop %0; cli" : "=r"(flags)::"memory");
+        return (flags & 0x200) != 0;
+    }
+
+    inline void restore_interrupts(const bool enabled) {
+        if (enabled) asm volatile("sti" ::: "memory");
+    }
+
     // Other
 
     inline void wait() {
         byte_out(0x80, 0);
     }
+
+    inline void pause() {
+        asm volatile("pause" ::: "memory");
+    }
 } // namespace cosmos::utils
@@ -57,7 +57,9 @@ namespace cosmos::vfs::devfs {
         if (name.contains("/")) return;
         name = name.trim();
 
-        const auto device = node->children.push_back_alloc(sizeof(FileOps*) + name.size() + 1);
+        const auto device = node->children.alloc(sizeof(FileOps*) + name.size() + 1);
+        if (device == nullptr) return;
+
         utils::memset(device, 0, sizeof(Node));
         *reinterpret_cast<const FileOps**>(device + 1) = ops;
 
@@ -69,5 +71,7 @@ namespace cosmos::vfs::devfs {
 
         utils::memcpy(const_cast<char*>(device->name.data()), name.data(), name.size());
         const_cast<char*>(device->name.data())[name.size()] = '\0';
+
+        node->children.push_back(device);
     }
 } // namespace cosmos::vfs::devfs
@@ -263,7 +263,8 @@ namespace cosmos::vfs::iso9660 {
                 }
 
                 // Create child
-                const auto child = node->children.push_back_alloc(sizeof(NodeInfo) + name.size() + 1);
+                const auto child = node->children.alloc(sizeof(NodeInfo) + name.size() + 1);
+                if (child == nullptr) break;
 
                 child->parent = node;
                 child->mount_root = false;
@@ -271,8 +272,7 @@ namespace cosmos::vfs::iso9660 {
                 child->name = stl::StringView(reinterpret_cast<char*>(child + 1) + sizeof(NodeInfo), name.size());
                 child->fs_ops = node->fs_ops;
                 child->fs_handle = node->fs_handle;
-                child->open_read = 0;
-                child->open_write = 0;
+                child->open_state = 0;
                 child->populated = false;
                 child->children = {};
 
@@ -283,6 +283,8 @@ namespace cosmos::vfs::iso9660 {
                 const auto child_node_info = reinterpret_cast<NodeInfo*>(child + 1);
                 child_node_info->data_offset = (entry->data_lba + entry->extended_length) * fs_info->block_size;
                 child_node_info->data_size = entry->data_size;
+
+                node->children.push_back(child);
             }
 
             entry_index++;
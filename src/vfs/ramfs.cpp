@@ -1,6 +1,7 @@
 #include "ramfs.hpp"
 
 #include "memory/heap.hpp"
+#include "scheduler/rcu.hpp"
 #include "stl/linked_list.hpp"
 #include "stl/string_view.hpp"
 #include "types.hpp"
@@ -87,11 +88,15 @@ namespace cosmos::vfs::ramfs {
         Node* node;
 
         if (type == NodeType::Directory) {
-            node = parent->children.push_back_alloc(name.size() + 1);
+            node = parent->children.alloc(name.size() + 1);
+            if (node == nullptr) return nullptr;
+
             node->name = stl::StringView(reinterpret_cast<const char*>(node + 1), name.size());
             node->populated = true;
         } else {
-            node = parent->children.push_back_alloc(sizeof(FileInfo) + name.size() + 1);
+            node = parent->children.alloc(sizeof(FileInfo) + name.size() + 1);
+            if (node == nullptr) return nullptr;
+
             node->name = stl::StringView(reinterpret_cast<const char*>(node) + sizeof(Node) + sizeof(FileInfo), name.size());
             node->populated = false;
 
@@ -104,25 +109,28 @@ namespace cosmos::vfs::ramfs {
         node->type = type;
         node->fs_ops = parent->fs_ops;
         node->fs_handle = parent->fs_handle;
-        node->open_read = 0;
-        node->open_write = 0;
+        node->open_state = 0;
         node->children = {};
 
         utils::memcpy(const_cast<char*>(node->name.data()), name.data(), name.size());
         const_cast<char*>(node->name.data())[name.size()] = '\0';
 
+        parent->children.push_back(node);
         return node;
     }
 
     bool fs_destroy(Node* node) {
         for (auto it = node->parent->children.begin(); it != stl::LinkedList<Node>::end(); ++it) {
             if (*it == node) {
+                // The node cannot be opened anymore, only lookups still running might look at it
                 if (node->type == NodeType::File) {
                     const auto info = reinterpret_cast<FileInfo*>(node + 1);
                     if (info->data != nullptr) memory::heap::free(info->data);
                 }
 
-                node->parent->children.remove_free(it);
+                node->parent->children.unlink(it.prev, it.node);
+                scheduler::rcu_free(it.node);
+
                 return true;
             }
         }
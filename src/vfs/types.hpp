@@ -3,6 +3,7 @@
 #include "stl/linked_list.hpp"
 #include "stl/string_view.hpp"
 
+#include <atomic>
 #include <cstdint>
 
 namespace cosmos::vfs {
@@ -14,6 +15,8 @@ namespace cosmos::vfs {
 
     // Fs
 
+    /// Called with the tree locked. Nodes are looked up without locks, so new ones need to be filled in before they are linked
+    /// into the children of their parent, and removed ones can only be freed after an RCU grace period.
     struct FsOps {
         Node* (*create)(Node* parent, NodeType type, stl::StringView name);
         bool (*destroy)(Node* node);
@@ -30,6 +33,11 @@ namespace cosmos::vfs {
         File,
     };
 
+    /// Node::open_state holds the number of readers in the low bits, plus flags for an open writer and for removed nodes
+    constexpr uint32_t OPEN_READERS = 0xFFFF;
+    constexpr uint32_t OPEN_WRITER = 1u << 16;
+    constexpr uint32_t NODE_REMOVED = 1u << 17;
+
     struct Node {
         Node* parent;
 
@@ -40,10 +48,9 @@ namespace cosmos::vfs {
         const FsOps* fs_ops;
         void* fs_handle;
 
-        uint16_t open_read;
-        uint16_t open_write;
+        std::atomic<uint32_t> open_state;
 
-        bool populated;
+        std::atomic<bool> populated;
         stl::LinkedList<Node> children;
     };
 
@@ -2,6 +2,8 @@
 
 #include "log/log.hpp"
 #include "path.hpp"
+#include "scheduler/rcu.hpp"
+#include "sync/mutex.hpp"
 #include "utils.hpp"
 
 namespace cosmos::vfs {
@@ -13,11 +15,61 @@ namespace cosmos::vfs {
 
     static stl::LinkedList<Filesystem> filesystems = {};
 
-    static Node* root = nullptr;
+    static std::atomic<Node*> root = nullptr;
 
-    Node* find_node(const stl::StringView& path, Node*& parent, stl::SplitIterator& it) {
+    /// Serializes everything which changes the tree, lookups walk it without locks inside RCU read side sections
+    static sync::Mutex tree_mutex;
+
+    // Open state
+
+    /// Counts the node as open for the mode, which keeps it from being removed. Fails if that conflicts with how it is open already.
+    bool pin(Node* node, const Mode mode) {
+        auto state = node->open_state.load(std::memory_order_relaxed);
+
+        for (;;) {
+            if ((state & (NODE_REMOVED | OPEN_WRITER)) != 0) return false;
+            if (is_write(mode) && (state & OPEN_READERS) != 0) return false;
+
+            auto next = state;
+            if (is_read(mode)) next++;
+            if (is_write(mode)) next |= OPEN_WRITER;
+
+            if (node->open_state.compare_exchange_weak(state, next, std::memory_order_acquire, std::memory_order_relaxed)) return true;
+        }
+    }
+
+    void unpin(Node* node, const Mode mode) {
+        node->open_state.fetch_sub((is_read(mode) ? 1 : 0) + (is_write(mode) ? OPEN_WRITER : 0), std::memory_order_release);
+    }
+
+    /// Fails while the node is open, afterwards it cannot be opened anymore
+    bool mark_removed(Node* node) {
+        uint32_t expected = 0;
+        return node->open_state.compare_exchange_strong(expected, NODE_REMOVED);
+    }
+
+    // Lookup
+
+    void populate(Node* node) {
+        // Writers already hold the lock while they look up their path
+        if (tree_mutex.is_held()) {
+            node->fs_ops->populate(node);
+            return;
+        }
+
+        const sync::MutexGuard guard(tree_mutex);
+
+        // Another process might have populated it while this one was waiting
+        if (!node->populated) node->fs_ops->populate(node);
+    }
+
+    /// Needs an RCU read side section. Stops at the first directory on the way which is not populated yet, unless it is the
+    /// one which was just tried to populate.
+    Node* walk(const stl::StringView& path, Node*& parent, stl::SplitIterator& it, Node*& unpopulated, const Node* attempted) {
         parent = nullptr;
-        auto node = root;
+        unpopulated = nullptr;
+
+        auto node = root.load(std::memory_order_acquire);
 
         it = stl::split(path, '/');
 
@@ -25,7 +77,10 @@ namespace cosmos::vfs {
             auto found = false;
 
             if (node->type == NodeType::Directory) {
-                if (!node->populated) node->fs_ops->populate(node);
+                if (!node->populated && node != attempted) {
+                    unpopulated = node;
+                    return nullptr;
+                }
 
                 for (const auto child : node->children) {
                     if (child->name == it.entry) {
@@ -47,6 +102,32 @@ namespace cosmos::vfs {
         return node;
     }
 
+    /// Populates the directories on the way if needed. Returns inside an RCU read side section which the caller has to end,
+    /// the returned nodes are only guaranteed to stay around until then unless the tree lock is held.
+    Node* find_node(const stl::StringView& path, Node*& parent, stl::SplitIterator& it) {
+        const Node* attempted = nullptr;
+
+        for (;;) {
+            scheduler::rcu_read_lock();
+
+            Node* unpopulated;
+            const auto node = walk(path, parent, it, unpopulated, attempted);
+
+            if (unpopulated == nullptr) return node;
+
+            // Populating blocks, the pin keeps the directory from being removed outside of the read side section
+            const auto pinned = pin(unpopulated, Mode::Read);
+            scheduler::rcu_read_unlock();
+
+            if (pinned) {
+                populate(unpopulated);
+                unpin(unpopulated, Mode::Read);
+            }
+
+            attempted = unpopulated;
+        }
+    }
+
     void register_filesystem(const stl::StringView name, const std::size_t additional_root_node_size, const FsInitFn init_fn) {
         const auto filesystem = filesystems.push_back_alloc(name.size() + 1);
 
@@ -88,48 +169,49 @@ namespace cosmos::vfs {
         if (length == 0) return nullptr;
         target_path = target_path.substr(0, length);
 
+        const sync::MutexGuard guard(tree_mutex);
+
         // Mount at /
         if (target_path == "/") {
-            if (root != nullptr) return nullptr;
-
-            root = static_cast<Node*>(memory::heap::alloc(sizeof(Node) + fs->additional_root_node_size + length + 1, alignof(Node)));
-            init_mount_node(root, nullptr, fs, target_path.substr(0, length));
+            if (root.load() != nullptr) return nullptr;
 
-            if (!fs->init_fn(root, device_path)) {
-                memory::heap::free(root);
-                root = nullptr;
+            const auto node = static_cast<Node*>(memory::heap::alloc(sizeof(Node) + fs->additional_root_node_size + length + 1, alignof(Node)));
+            init_mount_node(node, nullptr, fs, target_path.substr(0, length));
 
+            if (!fs->init_fn(node, device_path)) {
+                memory::heap::free(node);
                 return nullptr;
             }
 
+            root.store(node, std::memory_order_release);
+
             INFO("Mounted filesystem '%s' at %s", fs->name.data(), target_path.data());
-            return root;
+            return node;
         }
 
-        // Get parent directory node
+        // Get parent directory node, the lock keeps it around after the read side section
         Node* parent;
         stl::SplitIterator it;
         auto node = find_node(target_path, parent, it);
+        scheduler::rcu_read_unlock();
 
         if (node != nullptr) return nullptr;
         if (parent->type != NodeType::Directory) return nullptr;
         if (it.next()) return nullptr;
 
-        // Mount as child
-        node = parent->children.push_back_alloc(fs->additional_root_node_size + it.entry.size() + 1);
+        // Mount as child, only linked once the filesystem is ready
+        node = parent->children.alloc(fs->additional_root_node_size + it.entry.size() + 1);
+        if (node == nullptr) return nullptr;
+
         init_mount_node(node, parent, fs, it.entry);
 
         if (!fs->init_fn(node, device_path)) {
-            for (auto child_it = parent->children.begin(); child_it != stl::LinkedList<Node>::end(); ++child_it) {
-                if (*child_it == node) {
-                    parent->children.remove_free(child_it);
-                    break;
-                }
-            }
-
+            memory::heap::free(stl::LinkedList<Node>::node_of(node));
             return nullptr;
         }
 
+        parent->children.push_back(node);
+
         INFO("Mounted filesystem '%s' at %s", fs->name.data(), target_path.data());
         return node;
     }
@@ -139,26 +221,53 @@ namespace cosmos::vfs {
         if (length == 0) return false;
         path = path.substr(0, length);
 
+        const sync::MutexGuard guard(tree_mutex);
+
         Node* parent;
         stl::SplitIterator it;
         const auto node = find_node(path, parent, it);
+        scheduler::rcu_read_unlock();
 
         if (parent == nullptr) return false;
         if (node == nullptr || !node->mount_root) return false;
         if (it.next()) return false;
+        if (!mark_removed(node)) return false;
 
         for (auto child_it = parent->children.begin(); child_it != stl::LinkedList<Node>::end(); ++child_it) {
             if (*child_it == node) {
-                parent->children.remove_free(child_it);
-                INFO("Unmounted filesystem at %s", path.data());
+                // Lookups which already got to the node can still be looking at it
+                parent->children.unlink(child_it.prev, child_it.node);
+                scheduler::rcu_free(child_it.node);
 
+                INFO("Unmounted filesystem at %s", path.data());
                 return true;
             }
         }
 
+        node->open_state = 0;
         return false;
     }
 
+    /// Slow path of open_file(), creates the file with the tree locked unless another process was faster. Returns it pinned.
+    Node* create_file(const stl::StringView& path, const Mode mode) {
+        const sync::MutexGuard guard(tree_mutex);
+
+        Node* parent;
+        stl::SplitIterator it;
+        auto node = find_node(path, parent, it);
+        scheduler::rcu_read_unlock();
+
+        if (node == nullptr) {
+            if (it.next() || parent->type != NodeType::Directory) return nullptr;
+
+            node = parent->fs_ops->create(parent, NodeType::File, it.entry);
+            if (node == nullptr) return nullptr;
+        }
+
+        if (node->type != NodeType::File || !pin(node, mode)) return nullptr;
+        return node;
+    }
+
     File* open_file(stl::StringView path, const Mode mode) {
         const auto length = check_abs_path(path);
         if (length == 0) return nullptr;
@@ -168,44 +277,50 @@ namespace cosmos::vfs {
         stl::SplitIterator it;
         auto node = find_node(path, parent, it);
 
-        if (node == nullptr && !it.next() && is_write(mode) && parent->type == NodeType::Directory) {
-            node = parent->fs_ops->create(parent, NodeType::File, it.entry);
-        }
-
-        if (node != nullptr) {
-            if (node->type != NodeType::File) return nullptr;
-            if (node->open_write > 0) return nullptr;
-            if (is_write(mode) && node->open_read > 0) return nullptr;
+        const auto missing = node == nullptr && !it.next() && parent->type == NodeType::Directory;
+        const auto pinned = node != nullptr && node->type == NodeType::File && pin(node, mode);
 
-            const auto ops = node->fs_ops->open(node, mode);
-            if (ops == nullptr) return nullptr;
+        scheduler::rcu_read_unlock();
 
-            if (is_read(mode)) node->open_read++;
-            if (is_write(mode)) node->open_write++;
+        if (missing && is_write(mode)) {
+            node = create_file(path, mode);
+            if (node == nullptr) return nullptr;
+        } else if (!pinned) {
+            return nullptr;
+        }
 
-            const auto file = memory::heap::alloc<File>();
-            file->ops = ops;
-            file->node = node;
-            file->mode = mode;
-            file->cursor = 0;
+        const auto ops = node->fs_ops->open(node, mode);
 
-            return file;
+        if (ops == nullptr) {
+            unpin(node, mode);
+            return nullptr;
         }
 
-        return nullptr;
+        const auto file = memory::heap::alloc<File>();
+        file->ops = ops;
+        file->node = node;
+        file->mode = mode;
+        file->cursor = 0;
+
+        return file;
     }
 
     void close_file(File* file) {
-        if (is_read(file->mode)) file->node->open_read--;
-        if (is_write(file->mode)) file->node->open_write--;
-
         file->node->fs_ops->on_close(file);
+        unpin(file->node, file->mode);
+
         memory::heap::free(file);
     }
 
     struct Dir {
         Node* node;
-        stl::LinkedList<Node>::Iterator it;
+
+        /// Entries are counted instead of keeping a pointer, the one it pointed to might be removed between calls
+        uint32_t index;
+
+        /// Copy of the last name returned, the child it came from can be freed once the read side section ends
+        char* name;
+        std::size_t name_capacity;
     };
 
     void* open_dir(stl::StringView path) {
@@ -217,35 +332,69 @@ namespace cosmos::vfs {
         stl::SplitIterator it;
         const auto node = find_node(path, parent, it);
 
-        if (node != nullptr && node->type == NodeType::Directory) {
-            if (!node->populated) node->fs_ops->populate(node);
+        const auto pinned = node != nullptr && node->type == NodeType::Directory && pin(node, Mode::Read);
+        scheduler::rcu_read_unlock();
+
+        if (!pinned) return nullptr;
 
-            node->open_read++;
+        // Lookups only populate the directories on the way
+        if (!node->populated) populate(node);
 
-            const auto dir = memory::heap::alloc<Dir>();
-            dir->node = node;
-            dir->it = node->children.begin();
+        const auto dir = memory::heap::alloc<Dir>();
+        dir->node = node;
+        dir->index = 0;
+        dir->name = nullptr;
+        dir->name_capacity = 0;
 
-            return dir;
+        return dir;
+    }
+
+    /// Needs an RCU read side section, the heap only takes a spin lock
+    bool copy_name(Dir* dir, const stl::StringView& name) {
+        if (name.size() + 1 > dir->name_capacity) {
+            const auto buffer = memory::heap::alloc_array<char>(name.size() + 1);
+            if (buffer == nullptr) return false;
+
+            if (dir->name != nullptr) memory::heap::free(dir->name);
+
+            dir->name = buffer;
+            dir->name_capacity = name.size() + 1;
         }
 
-        return nullptr;
+        utils::memcpy(dir->name, name.data(), name.size());
+        dir->name[name.size()] = '\0';
+
+        return true;
     }
 
     stl::StringView read_dir(void* dir) {
         const auto d = static_cast<Dir*>(dir);
 
-        if (d->it != stl::LinkedList<Node>::end()) {
-            return (d->it++)->name;
+        stl::StringView name = { "", 0 };
+        auto index = 0u;
+
+        scheduler::rcu_read_lock();
+
+        for (const auto child : d->node->children) {
+            if (index++ == d->index) {
+                if (copy_name(d, child->name)) {
+                    name = stl::StringView(d->name, child->name.size());
+                    d->index++;
+                }
+
+                break;
+            }
         }
 
-        return { "", 0 };
+        scheduler::rcu_read_unlock();
+        return name;
     }
 
     void close_dir(void* dir) {
         const auto d = static_cast<Dir*>(dir);
-        d->node->open_read--;
+        unpin(d->node, Mode::Read);
 
+        if (d->name != nullptr) memory::heap::free(d->name);
         memory::heap::free(d);
     }
 
@@ -254,9 +403,12 @@ namespace cosmos::vfs {
         if (length == 0) return false;
         path = path.substr(0, length);
 
+        const sync::MutexGuard guard(tree_mutex);
+
         Node* parent;
         stl::SplitIterator it;
         auto node = find_node(path, parent, it);
+        scheduler::rcu_read_unlock();
 
         if (node == nullptr && !it.next() && parent->type == NodeType::Directory) {
             node = parent->fs_ops->create(parent, NodeType::Directory, it.entry);
@@ -271,18 +423,24 @@ namespace cosmos::vfs {
         if (length == 0) return false;
         path = path.substr(0, length);
 
+        const sync::MutexGuard guard(tree_mutex);
+
         Node* parent;
         stl::SplitIterator it;
         const auto node = find_node(path, parent, it);
+        scheduler::rcu_read_unlock();
 
-        if (node == nullptr) return false;
-        if (node->open_read > 0 || node->open_write > 0) return false;
+        if (node == nullptr || parent == nullptr) return false;
 
         if (node->type == NodeType::Directory) {
-            if (!node->populated) node->fs_ops->populate(node);
+            if (!node->populated) populate(node);
             if (!node->children.empty()) return false;
         }
 
-        return node->fs_ops->destroy(node);
+        if (!mark_removed(node)) return false;
+        if (node->fs_ops->destroy(node)) return true;
+
+        node->open_state = 0;
+        return false;
     }
 } // namespace cosmos::vfs
@@ -14,6 +14,8 @@ namespace cosmos::vfs {
     void close_file(File* file);
 
     void* open_dir(stl::StringView path);
+    /// The name is a copy owned by the directory handle, it stays valid until the next read_dir() or close_dir().
+    /// Returns an empty name once all entries were read.
     stl::StringView read_dir(void* dir);
     void close_dir(void* dir);
 